@@ -0,0 +1,97 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+#include <string.h>
+#include "frame-queue.h"
+
+typedef struct
+{
+    uint32_t tick;
+    uint8_t cmd;
+    uint8_t length;
+    uint8_t data[FRAME_QUEUE_DATA_SIZE];
+} frameQueue_entry_t;
+
+static frameQueue_entry_t entries[FRAME_QUEUE_SIZE];
+
+/**
+ * The order of the entries, order[0] is the entry with the earliest tick.
+ * Only the indices are moved when sorting, not the entries.
+ */
+static uint8_t order[FRAME_QUEUE_SIZE];
+static uint8_t count = 0;
+
+bool frameQueue_push(uint32_t tick, const mesp_data_frame_t *frame)
+{
+    if (count >= FRAME_QUEUE_SIZE)
+        return false;
+    const uint8_t length = frame->length > FRAME_QUEUE_DATA_SIZE ?
+            FRAME_QUEUE_DATA_SIZE : frame->length; // like the receiver drops what does not fit its buffer
+
+    // find an unused entry
+    uint8_t unused, i;
+    for (unused = 0; unused < FRAME_QUEUE_SIZE; unused++)
+    {
+        for (i = 0; i < count; i++)
+            if (order[i] == unused)
+                break;
+        if (i == count)
+            break;
+    }
+
+    frameQueue_entry_t *entry = &entries[unused];
+    entry->tick = tick;
+    entry->cmd = frame->cmd;
+    entry->length = length;
+    memcpy(entry->data, frame->data, length);
+
+    // insert behind all entries with an earlier or equal tick, ticks wrap around
+    for (i = count; i > 0 && (int32_t) (entries[order[i - 1]].tick - tick) > 0;
+            i--)
+        order[i] = order[i - 1];
+    order[i] = unused;
+    count++;
+    return true;
+}
+
+bool frameQueue_pop(uint32_t now, mesp_data_frame_t *frame)
+{
+    if (count == 0)
+        return false;
+
+    const frameQueue_entry_t *entry = &entries[order[0]];
+    if ((int32_t) (now - entry->tick) < 0)
+        return false; // not due yet
+
+    frame->cmd = entry->cmd;
+    frame->length = entry->length;
+    memcpy(frame->data, entry->data, entry->length);
+
+    count--;
+    uint8_t i;
+    for (i = 0; i < count; i++)
+        order[i] = order[i + 1];
+    return true;
+}
+
+bool frameQueue_isEmpty(void)
+{
+    return count == 0;
+}
+
+bool frameQueue_isFull(void)
+{
+    return count >= FRAME_QUEUE_SIZE;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+#ifndef FRAME_QUEUE_H_
+#define FRAME_QUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mesp.h"
+#include "ws2812b.h"
+
+// Number of frames that can wait for their tick
+#define FRAME_QUEUE_SIZE 4
+
+// Maximum data length of a queued frame, enough for a frame of individual colors
+#if WS2812B_LED_COUNT * WS2812B_CHANNEL_COUNT > 0xFF
+#define FRAME_QUEUE_DATA_SIZE 0xFF
+#else
+#define FRAME_QUEUE_DATA_SIZE (WS2812B_LED_COUNT * WS2812B_CHANNEL_COUNT)
+#endif
+
+/**
+ * This function adds a frame that should be applied at 'tick'. The queue is kept sorted by tick.
+ * Data beyond FRAME_QUEUE_DATA_SIZE bytes is dropped, the length is truncated.
+ *
+ * @param tick The tick the frame should be applied at
+ * @param frame The frame, its data is copied
+ *
+ * @return false if the queue is full
+ */
+extern bool frameQueue_push(uint32_t tick, const mesp_data_frame_t *frame);
+
+/**
+ * This function removes the earliest frame from the queue if its tick has been reached.
+ *
+ * @param now The current tick
+ * @param frame The frame to copy the queued frame into, 'frame->data' has to hold FRAME_QUEUE_DATA_SIZE bytes
+ *
+ * @return true if a frame is due and has been copied into 'frame'
+ */
+extern bool frameQueue_pop(uint32_t now, mesp_data_frame_t *frame);
+
+/**
+ * This function checks whether frames are waiting in the queue.
+ *
+ * @return true if the queue is empty
+ */
+extern bool frameQueue_isEmpty(void);
+
+/**
+ * This function checks whether another frame can be added.
+ *
+ * @return true if the queue is full
+ */
+extern bool frameQueue_isFull(void);
+
+#endif /* FRAME_QUEUE_H_ */
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Cost of the current limiter for the strip length it has been built for (WS2812B_LED_COUNT). Each length is built
+ * with a budget that 10 white leds exceed and with the limiter compiled out (WS2812B_POWER_BUDGET_MA 0), see Makefile.
+ *
+ * showStrip: ws2812b_showStrip under the shim with the limiter off, within the budget and over it. Reported are
+ *            the MCLK cycles of the encoding (cycle-model.h) and the time from the call to the return.
+ * estimate:  ws2812b_estimateCurrent, the part of the limiter every frame within the budget pays for
+ * set:       ws2812b_setLEDColor of one led, keeping the channel sums up to date
+ * swap:      ws2812b_swapBuffers of a whole INDIVIDUAL frame, copying and summing every led once
+ *
+ * estimate, set and swap do not touch any register, so the shim can not see them. They are timed on the host
+ * instead, the absolute numbers do not carry over to the MSP430 but the way they grow with the strip does.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "shim.h"
+#include "esp.h"
+#include "ws2812b.h"
+
+#define SHOW_FRAMES 10 // per measurement under the shim
+#define BENCH_NS 200e6 // per measurement on the host
+
+static void idle(void)
+{
+}
+
+// Shows the strip SHOW_FRAMES times, returns the encode cycles and sets the time per frame
+static double benchShow(double *show_us)
+{
+    const double cycles = shim_cycles[SHIM_SUB_ENCODE];
+    double ns = 0;
+    unsigned i;
+    for (i = 0; i < SHOW_FRAMES; i++)
+    {
+        shim_run(&idle, shim_spiIdleNs() + 100e3); // the last frame has been latched
+        shim_spiClear();
+        const double start_ns = shim_now_ns();
+        ws2812b_showStrip();
+        ns += shim_now_ns() - start_ns;
+    }
+    *show_us = ns / SHOW_FRAMES / 1e3;
+    return (shim_cycles[SHIM_SUB_ENCODE] - cycles) / SHOW_FRAMES;
+}
+
+#if WS2812B_POWER_BUDGET_MA > 0
+static volatile uint32_t sink; // keeps the results alive
+
+static double nowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static double benchEstimate(void)
+{
+    uint32_t calls = 0;
+    const double start = nowNs();
+    double end;
+    do
+    {
+        uint16_t i;
+        for (i = 0; i < 1000; i++)
+            sink += ws2812b_estimateCurrent();
+        calls += 1000;
+    }
+    while ((end = nowNs()) - start < BENCH_NS);
+    return (end - start) / calls;
+}
+
+static double benchSet(void)
+{
+    uint32_t calls = 0;
+    const double start = nowNs();
+    double end;
+    do
+    {
+        uint16_t i;
+        for (i = 0; i < 1000; i++)
+            ws2812b_setLEDColor((uint16_t) (calls + i) % WS2812B_LED_COUNT,
+                                (uint8_t) i, (uint8_t) (i >> 1), (uint8_t) (i >> 2));
+        calls += 1000;
+    }
+    while ((end = nowNs()) - start < BENCH_NS);
+    return (end - start) / calls;
+}
+
+static double benchSwap(void)
+{
+    uint32_t calls = 0;
+    const double start = nowNs();
+    double end;
+    do
+    {
+        uint16_t i;
+        for (i = 0; i < 100; i++)
+        {
+            ws2812b_getBackBuffer()[i % WS2812B_LED_COUNT] ^= 0xFF; // written by the receiver
+            ws2812b_swapBuffers(WS2812B_LED_COUNT);
+        }
+        calls += 100;
+    }
+    while ((end = nowNs()) - start < BENCH_NS);
+    return (end - start) / calls;
+}
+#endif
+
+int main(void)
+{
+    shim_reset();
+    esp_reset(); // nothing to send
+    ws2812b_initClockTo25MHz();
+    ws2812b_initSPI();
+
+    double show_us;
+    ws2812b_fillStrip(0x10, 0x10, 0x10); // within the budget of every build
+#if WS2812B_POWER_BUDGET_MA == 0
+    const double off_cycles = benchShow(&show_us);
+    printf("%3u leds limiter off    showStrip %7.0f cycles %8.1f us/frame\n", WS2812B_LED_COUNT,
+           off_cycles, show_us);
+#else
+    const double under_cycles = benchShow(&show_us);
+    printf("%3u leds within budget  showStrip %7.0f cycles %8.1f us/frame\n", WS2812B_LED_COUNT,
+           under_cycles, show_us);
+
+    ws2812b_fillStrip(0xFF, 0xFF, 0xFF);
+    if (ws2812b_estimateCurrent() <= WS2812B_POWER_BUDGET_MA)
+    {
+        fprintf(stderr, "bench-limiter: %umA of white leds are within the budget\n", ws2812b_estimateCurrent());
+        return 1;
+    }
+    const double over_cycles = benchShow(&show_us);
+    printf("%3u leds over budget    showStrip %7.0f cycles %8.1f us/frame  (+%.0f cycles, %.1f per led)\n",
+           WS2812B_LED_COUNT, over_cycles, show_us, over_cycles - under_cycles,
+           (over_cycles - under_cycles) / WS2812B_LED_COUNT);
+
+    const double estimate_ns = benchEstimate();
+    const double set_ns = benchSet();
+    const double swap_ns = benchSwap();
+    printf("%3u leds limiter        estimate %5.1f ns/frame  set %5.1f ns/led  swap %7.1f ns/frame (%4.2f ns/led)\n",
+           WS2812B_LED_COUNT, estimate_ns, set_ns, swap_ns, swap_ns / WS2812B_LED_COUNT);
+#endif
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Throughput of the lamp for the strip length it has been built for (WS2812B_LED_COUNT).
+ *
+ * stream:   the ESP sends the next INDIVIDUAL frame as soon as the last one has been shown (closed loop)
+ * spectrum: the spectrum effect runs on a 500Hz tone for one second
+ *
+ * Reported per frame: bytes on the strip's data line, bytes on the MESP link and the estimated MCLK cycles
+ * per subsystem (see shim.h and cycle-model.h).
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "shim.h"
+#include "esp.h"
+#include "cycle-model.h"
+#include "mesp-ws2812b.h"
+#include "ws2812b.h"
+
+#define MS 1e6
+#define STREAM_FRAMES 100
+#define TONE_HZ 500.0
+
+static const char *const sub_names[SHIM_SUB_COUNT] = { "main", "encode",
+                                                       "spectrum", "spi wait",
+                                                       "clock wait", "flash",
+                                                       "isr usci_a0",
+                                                       "isr timer1",
+                                                       "isr dma" };
+
+static uint8_t stream_colors[3 * WS2812B_LED_COUNT];
+static uint32_t stream_sent;
+
+// Snapshot of the counters at the start of a scenario
+typedef struct
+{
+    double ns;
+    double sleep_ns;
+    double cycles[SHIM_SUB_COUNT];
+    uint32_t strips;
+    size_t wire_bytes;
+} bench_mark_t;
+
+static void mark(bench_mark_t *mark)
+{
+    mark->ns = shim_now_ns();
+    mark->sleep_ns = shim_sleepNs();
+    memcpy(mark->cycles, shim_cycles, sizeof(mark->cycles));
+    mark->strips = cycleModel_strips;
+    shim_spiLog(&mark->wire_bytes);
+}
+
+static void report(const char *name, const bench_mark_t *start,
+                   double link_bytes)
+{
+    bench_mark_t end;
+    mark(&end);
+    const uint32_t frames = end.strips - start->strips;
+    const double seconds = (end.ns - start->ns) * 1e-9;
+    if (frames == 0)
+    {
+        printf("%3u leds %-8s no frames\n", WS2812B_LED_COUNT, name);
+        return;
+    }
+
+    printf("%3u leds %-8s %6.1f fps  wire %4.0f B/frame  link %4.0f B/frame  asleep %4.1f%%\n",
+           WS2812B_LED_COUNT, name, frames / seconds,
+           (double) (end.wire_bytes - start->wire_bytes) / frames,
+           link_bytes / frames,
+           100 * (end.sleep_ns - start->sleep_ns) / (end.ns - start->ns));
+    printf("%3u leds %-8s cycles/frame:", WS2812B_LED_COUNT, name);
+    int sub;
+    for (sub = 0; sub < SHIM_SUB_COUNT; sub++)
+        printf(" %s %.0f", sub_names[sub],
+               (end.cycles[sub] - start->cycles[sub]) / frames);
+    printf("\n");
+}
+
+// Called after every refresh of the strip: the ESP sends the next frame after its minimum gap
+static void streamNext(void)
+{
+    if (stream_sent == STREAM_FRAMES)
+    {
+        shim_stop();
+        return;
+    }
+    stream_colors[stream_sent % sizeof(stream_colors)] ^= 0xFF; // every frame differs
+    esp_send(MESP_WS2812B_CMD_INDIVIDUAL, stream_colors, sizeof(stream_colors),
+             shim_globalNs());
+    stream_sent++;
+}
+
+static void benchStream(void)
+{
+    uint16_t i;
+    for (i = 0; i < sizeof(stream_colors); i++)
+        stream_colors[i] = (uint8_t) (31 * i);
+
+    bench_mark_t start;
+    mark(&start);
+    stream_sent = 0;
+    cycleModel_onStrip = &streamNext;
+    streamNext();
+    shim_run(mespWS2812B_loop, shim_now_ns() + 10000 * MS);
+    cycleModel_onStrip = NULL;
+    shim_run(mespWS2812B_loop, shim_now_ns() + 10 * MS); // the last frame has been sent by now
+
+    report("stream", &start, (4.0 + sizeof(stream_colors)) * stream_sent);
+}
+
+static uint16_t tone(double t_ns, void *context)
+{
+    (void) context;
+    return (uint16_t) (2048 + 1000 * sin(2 * M_PI * TONE_HZ * t_ns * 1e-9));
+}
+
+static void benchSpectrum(void)
+{
+    shim_setAdcSource(&tone, NULL);
+    esp_send(MESP_WS2812B_CMD_SPECTRUM, NULL, 0, shim_globalNs());
+    shim_run(mespWS2812B_loop, shim_now_ns() + 100 * MS); // the effect has started
+
+    bench_mark_t start;
+    mark(&start);
+    shim_run(mespWS2812B_loop, shim_now_ns() + 1000 * MS);
+    report("spectrum", &start, 0);
+
+    esp_send(MESP_WS2812B_CMD_CLEAR, NULL, 0, shim_globalNs());
+    shim_run(mespWS2812B_loop, shim_now_ns() + 100 * MS);
+    shim_setAdcSource(NULL, NULL);
+}
+
+int main(void)
+{
+    shim_reset();
+    esp_reset();
+    mespWS2812B_init();
+    mespWS2812B_enable();
+    shim_run(mespWS2812B_loop, 500 * MS);
+
+    benchStream();
+    benchSpectrum();
+    return 0;
+}
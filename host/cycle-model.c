@@ -0,0 +1,55 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+#include "ws2812b.h"
+#include "spectrum.h"
+#include "shim.h"
+#include "cycle-model.h"
+
+uint32_t cycleModel_strips;
+uint32_t cycleModel_blocks;
+void (*cycleModel_onStrip)(void);
+
+extern void __real_ws2812b_showStrip(void);
+extern bool __real_spectrum_process(uint8_t *levels);
+
+void __wrap_ws2812b_showStrip(void)
+{
+    cycleModel_strips++;
+    ws2812b_restoreClock(); // the encoding runs at full speed, as in ws2812b_showStrip
+    double cycles = 0;
+#if WS2812B_POWER_BUDGET_MA > 0
+    cycles += CYCLE_MODEL_LIMITER;
+    if (ws2812b_estimateCurrent() > WS2812B_POWER_BUDGET_MA) // the same decision as ws2812b_powerScale
+        cycles += CYCLE_MODEL_SCALE_BYTE * WS2812B_CHANNEL_COUNT * WS2812B_LED_COUNT;
+#endif
+#ifndef WS2812B_CHIP_APA102
+    cycles += CYCLE_MODEL_ENCODE_BYTE * WS2812B_CHANNEL_COUNT * WS2812B_LED_COUNT;
+#endif
+    shim_charge(SHIM_SUB_ENCODE, cycles);
+    __real_ws2812b_showStrip();
+    if (cycleModel_onStrip)
+        cycleModel_onStrip();
+}
+
+bool __wrap_spectrum_process(uint8_t *levels)
+{
+    if (!__real_spectrum_process(levels))
+        return false;
+    cycleModel_blocks++;
+    shim_charge(SHIM_SUB_SPECTRUM, CYCLE_MODEL_SPECTRUM_BLOCK);
+    return true;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Estimated MSP430 cycles of the firmware's compute loops, which the shim can not see as they do not touch
+ * any register. The functions are wrapped at link time (-Wl,--wrap) and charge these estimates before or after
+ * the real function runs. The numbers are counted from the instruction sequences the compiler emits for
+ * the loops with MPY32 (USE_HW_MPY=F5) and are estimates, not measurements.
+ */
+
+#ifndef HOST_CYCLE_MODEL_H_
+#define HOST_CYCLE_MODEL_H_
+
+#include <stdint.h>
+
+// ws2812b_showStrip
+#define CYCLE_MODEL_LIMITER 150      // ws2812b_powerScale: sum of the channel sums, one 32-bit division
+#define CYCLE_MODEL_ENCODE_BYTE 770  // ws2812b_encode_byte_6bit for one channel
+#define CYCLE_MODEL_SCALE_BYTE 30    // ws2812b_scale for one channel, only while the strip is over the budget
+
+// spectrum_process, per block
+#define CYCLE_MODEL_SPECTRUM_SAMPLE 20 // mean, peak and scaling of the block, per sample
+#define CYCLE_MODEL_GOERTZEL_ITERATION 38 // 16x32 product on the MPY32 and shift by 14
+#define CYCLE_MODEL_GOERTZEL_POWER 150    // 32-bit power and its logarithm, per band
+
+#define CYCLE_MODEL_SPECTRUM_BLOCK (SPECTRUM_BLOCK_SIZE * CYCLE_MODEL_SPECTRUM_SAMPLE \
+        + SPECTRUM_BAND_COUNT * (SPECTRUM_BLOCK_SIZE * CYCLE_MODEL_GOERTZEL_ITERATION \
+                + CYCLE_MODEL_GOERTZEL_POWER))
+
+extern uint32_t cycleModel_strips;  // calls of ws2812b_showStrip
+extern void (*cycleModel_onStrip)(void); // called after every ws2812b_showStrip
+extern uint32_t cycleModel_blocks;  // sample blocks processed by spectrum_process
+
+#endif /* HOST_CYCLE_MODEL_H_ */
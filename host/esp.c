@@ -0,0 +1,182 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp.h"
+#include "shim.h"
+#include "mesp.h"
+#include "mesp-ws2812b.h"
+
+#define ESP_FRAME_MAX (0xFF + 4)
+
+typedef struct
+{
+    uint8_t bytes[ESP_FRAME_MAX];
+    size_t count;
+    bool sync; // bytes 3 to 6 are filled in with the tick of the start code
+    double at_ns;
+    double start_ns;
+    double end_ns;
+} esp_frame_t;
+
+esp_config_t esp_config = { .byte_ns = 10000, .poll_ns = 10000, .react_ns =
+                                    5000,
+                            .gap_ns = 50000, .tick_ppm = 0 };
+
+static esp_frame_t *frames;
+static int frame_count, frame_size;
+static int sending;       // frame at the head of the queue
+static size_t next_byte;  // index of the next byte of that frame, 0 while waiting for RDY
+static double next_ns;    // time of the next event
+static double earliest_ns; // end of the gap after the last frame
+
+void esp_reset(void)
+{
+    frame_count = 0;
+    sending = 0;
+    next_byte = 0;
+    next_ns = INFINITY;
+    earliest_ns = 0;
+}
+
+static void schedule(void)
+{
+    if (!isinf(next_ns) || sending >= frame_count)
+        return; // busy or nothing to send
+    const esp_frame_t *frame = &frames[sending];
+    next_ns = frame->at_ns > earliest_ns ? frame->at_ns : earliest_ns;
+}
+
+int esp_sendRaw(const uint8_t *bytes, size_t count, double at_ns)
+{
+    if (frame_count == frame_size)
+    {
+        frame_size = frame_size ? frame_size * 2 : 64;
+        frames = realloc(frames, frame_size * sizeof(*frames));
+    }
+    esp_frame_t *frame = &frames[frame_count];
+    memcpy(frame->bytes, bytes, count);
+    frame->count = count;
+    frame->sync = false;
+    frame->at_ns = at_ns;
+    frame->start_ns = NAN;
+    frame->end_ns = NAN;
+    frame_count++;
+    schedule();
+    return frame_count - 1;
+}
+
+int esp_send(uint8_t cmd, const uint8_t *data, uint8_t length, double at_ns)
+{
+    uint8_t bytes[ESP_FRAME_MAX];
+    bytes[0] = MESP_START_CODE;
+    bytes[1] = cmd;
+    bytes[2] = length;
+    if (length)
+        memcpy(bytes + 3, data, length);
+    bytes[3 + length] = MESP_END_CODE;
+    return esp_sendRaw(bytes, 4 + (size_t) length, at_ns);
+}
+
+int esp_sendSync(double at_ns)
+{
+    const uint8_t placeholder[4] = { 0 };
+    const int index = esp_send(MESP_WS2812B_CMD_SYNC, placeholder, 4, at_ns);
+    frames[index].sync = true;
+    return index;
+}
+
+int esp_sendScheduled(uint32_t tick, uint8_t cmd, const uint8_t *data,
+                      uint8_t length, double at_ns)
+{
+    uint8_t payload[0xFF];
+    payload[0] = (uint8_t) tick;
+    payload[1] = (uint8_t) (tick >> 8);
+    payload[2] = (uint8_t) (tick >> 16);
+    payload[3] = (uint8_t) (tick >> 24);
+    payload[4] = cmd;
+    memcpy(payload + 5, data, length);
+    return esp_send(MESP_WS2812B_CMD_SCHEDULED, payload, 5 + length, at_ns);
+}
+
+bool esp_isIdle(void)
+{
+    return sending >= frame_count;
+}
+
+double esp_startNs(int frame)
+{
+    return frames[frame].start_ns;
+}
+
+double esp_endNs(int frame)
+{
+    return frames[frame].end_ns;
+}
+
+uint32_t esp_tick(double global_ns)
+{
+    return (uint32_t) (uint64_t) floor(
+            global_ns * 1e-9 * 32768 * (1 + esp_config.tick_ppm * 1e-6));
+}
+
+double esp_nextEventNs(void)
+{
+    return next_ns;
+}
+
+void esp_event(void)
+{
+    const double now = next_ns > shim_globalNs() ? next_ns : shim_globalNs();
+    esp_frame_t *frame = &frames[sending];
+    next_ns = INFINITY;
+
+    if (next_byte == 0 && isnan(frame->start_ns))
+    {
+        // waiting for RDY
+        if (!shim_rdy())
+        {
+            next_ns = now + esp_config.poll_ns;
+            return;
+        }
+        frame->start_ns = now + esp_config.react_ns;
+        if (frame->sync)
+        {
+            const uint32_t tick = esp_tick(frame->start_ns);
+            frame->bytes[3] = (uint8_t) tick;
+            frame->bytes[4] = (uint8_t) (tick >> 8);
+            frame->bytes[5] = (uint8_t) (tick >> 16);
+            frame->bytes[6] = (uint8_t) (tick >> 24);
+        }
+        next_ns = frame->start_ns;
+        return;
+    }
+
+    shim_uca0Receive(frame->bytes[next_byte++]);
+    if (next_byte < frame->count)
+    {
+        next_ns = now + esp_config.byte_ns;
+        return;
+    }
+
+    frame->end_ns = now;
+    earliest_ns = now + esp_config.gap_ns;
+    next_byte = 0;
+    sending++;
+    schedule();
+}
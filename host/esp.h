@@ -0,0 +1,81 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Scripted stand-in for the ESP. Frames are queued with the earliest time they may be sent at.
+ * The ESP samples RDY until it is high, then clocks the whole frame into USCI_A0 byte by byte without
+ * looking at RDY again. All times are on the global time line (see shim_globalNs).
+ */
+
+#ifndef HOST_ESP_H_
+#define HOST_ESP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct
+{
+    double byte_ns;  // from one byte to the next (8 bits at 1MHz and the gap of the SPI driver)
+    double poll_ns;  // RDY is sampled this often while a frame waits
+    double react_ns; // from seeing RDY high to the start code
+    double gap_ns;   // minimum time between the end code and the next start code
+    double tick_ppm; // frequency error of the ESP tick
+} esp_config_t;
+
+extern esp_config_t esp_config;
+
+extern void esp_reset(void);
+
+/**
+ * This function queues a frame. Frames are sent in the order they have been queued.
+ *
+ * @param cmd The command
+ * @param data The data of the frame
+ * @param length The data length
+ * @param at_ns The earliest time the frame may be sent at
+ *
+ * @return The index of the frame for esp_startNs and esp_endNs
+ */
+extern int esp_send(uint8_t cmd, const uint8_t *data, uint8_t length,
+                    double at_ns);
+
+/**
+ * This function queues raw bytes, e.g. a broken frame.
+ */
+extern int esp_sendRaw(const uint8_t *bytes, size_t count, double at_ns);
+
+/**
+ * This function queues a sync frame. Its tick is taken when the start code is sent.
+ */
+extern int esp_sendSync(double at_ns);
+
+/**
+ * This function queues a frame that should be applied at 'tick' of the ESP.
+ */
+extern int esp_sendScheduled(uint32_t tick, uint8_t cmd, const uint8_t *data,
+                             uint8_t length, double at_ns);
+
+extern bool esp_isIdle(void);     // every queued frame has been sent
+extern double esp_startNs(int frame); // the start code has been sent, NAN while not sent
+extern double esp_endNs(int frame);   // the end code has been sent, NAN while not sent
+extern uint32_t esp_tick(double global_ns); // 32768 ticks per second
+
+// called by the shim
+extern double esp_nextEventNs(void); // INFINITY if there is nothing to do
+extern void esp_event(void);
+
+#endif /* HOST_ESP_H_ */
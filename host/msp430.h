@@ -0,0 +1,324 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Host replacement for the TI device header. Only the registers, bits and intrinsics used by the firmware
+ * are provided. Every register access goes through shim_reg, which lets the model in shim.c account
+ * cycles, advance the simulated time and react to the value that has been written.
+ * The bit values are the ones of msp430f5529.h.
+ */
+
+#ifndef HOST_MSP430_H_
+#define HOST_MSP430_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum
+{
+    SHIM_WDTCTL,
+    SHIM_SFRIFG1,
+    SHIM_PMMCTL0_L,
+    SHIM_PMMCTL0_H,
+    SHIM_SVSMHCTL,
+    SHIM_SVSMLCTL,
+    SHIM_PMMIFG,
+    SHIM_UCSCTL0,
+    SHIM_UCSCTL1,
+    SHIM_UCSCTL2,
+    SHIM_UCSCTL3,
+    SHIM_UCSCTL4,
+    SHIM_UCSCTL5,
+    SHIM_UCSCTL6,
+    SHIM_UCSCTL7,
+    SHIM_P1OUT,
+    SHIM_P1DIR,
+    SHIM_P2SEL,
+    SHIM_P3SEL,
+    SHIM_P5SEL,
+    SHIM_P6SEL,
+    SHIM_UCA0CTL0,
+    SHIM_UCA0CTL1,
+    SHIM_UCA0IE,
+    SHIM_UCA0IV,
+    SHIM_UCA0RXBUF,
+    SHIM_UCB0CTL0,
+    SHIM_UCB0CTL1,
+    SHIM_UCB0BR0,
+    SHIM_UCB0BR1,
+    SHIM_UCB0IFG,
+    SHIM_UCB0STAT,
+    SHIM_UCB0TXBUF,
+    SHIM_TA0CTL,
+    SHIM_TA0CCR0,
+    SHIM_TA0CCR1,
+    SHIM_TA0CCTL1,
+    SHIM_TA1CTL,
+    SHIM_TA1R,
+    SHIM_TA1IV,
+    SHIM_TB0CTL,
+    SHIM_TB0CCTL6,
+    SHIM_TB0CCR6,
+    SHIM_ADC12CTL0,
+    SHIM_ADC12CTL1,
+    SHIM_ADC12CTL2,
+    SHIM_ADC12MCTL0,
+    SHIM_ADC12MEM0,
+    SHIM_DMACTL0,
+    SHIM_DMA0CTL,
+    SHIM_DMA0SA,
+    SHIM_DMA0DA,
+    SHIM_DMA0SZ,
+    SHIM_DMAIV,
+    SHIM_FCTL1,
+    SHIM_FCTL3,
+    SHIM_REG_COUNT
+} shim_reg_t;
+
+extern volatile uint16_t* shim_reg(shim_reg_t reg);
+
+#define SHIM_REG(reg) (*shim_reg(reg))
+
+#define WDTCTL SHIM_REG(SHIM_WDTCTL)
+#define SFRIFG1 SHIM_REG(SHIM_SFRIFG1)
+#define PMMCTL0_L SHIM_REG(SHIM_PMMCTL0_L)
+#define PMMCTL0_H SHIM_REG(SHIM_PMMCTL0_H)
+#define SVSMHCTL SHIM_REG(SHIM_SVSMHCTL)
+#define SVSMLCTL SHIM_REG(SHIM_SVSMLCTL)
+#define PMMIFG SHIM_REG(SHIM_PMMIFG)
+#define UCSCTL0 SHIM_REG(SHIM_UCSCTL0)
+#define UCSCTL1 SHIM_REG(SHIM_UCSCTL1)
+#define UCSCTL2 SHIM_REG(SHIM_UCSCTL2)
+#define UCSCTL3 SHIM_REG(SHIM_UCSCTL3)
+#define UCSCTL4 SHIM_REG(SHIM_UCSCTL4)
+#define UCSCTL5 SHIM_REG(SHIM_UCSCTL5)
+#define UCSCTL6 SHIM_REG(SHIM_UCSCTL6)
+#define UCSCTL7 SHIM_REG(SHIM_UCSCTL7)
+#define P1OUT SHIM_REG(SHIM_P1OUT)
+#define P1DIR SHIM_REG(SHIM_P1DIR)
+#define P2SEL SHIM_REG(SHIM_P2SEL)
+#define P3SEL SHIM_REG(SHIM_P3SEL)
+#define P5SEL SHIM_REG(SHIM_P5SEL)
+#define P6SEL SHIM_REG(SHIM_P6SEL)
+#define UCA0CTL0 SHIM_REG(SHIM_UCA0CTL0)
+#define UCA0CTL1 SHIM_REG(SHIM_UCA0CTL1)
+#define UCA0IE SHIM_REG(SHIM_UCA0IE)
+#define UCA0IV SHIM_REG(SHIM_UCA0IV)
+#define UCA0RXBUF SHIM_REG(SHIM_UCA0RXBUF)
+#define UCB0CTL0 SHIM_REG(SHIM_UCB0CTL0)
+#define UCB0CTL1 SHIM_REG(SHIM_UCB0CTL1)
+#define UCB0BR0 SHIM_REG(SHIM_UCB0BR0)
+#define UCB0BR1 SHIM_REG(SHIM_UCB0BR1)
+#define UCB0IFG SHIM_REG(SHIM_UCB0IFG)
+#define UCB0STAT SHIM_REG(SHIM_UCB0STAT)
+#define UCB0TXBUF SHIM_REG(SHIM_UCB0TXBUF)
+#define TA0CTL SHIM_REG(SHIM_TA0CTL)
+#define TA0CCR0 SHIM_REG(SHIM_TA0CCR0)
+#define TA0CCR1 SHIM_REG(SHIM_TA0CCR1)
+#define TA0CCTL1 SHIM_REG(SHIM_TA0CCTL1)
+#define TA1CTL SHIM_REG(SHIM_TA1CTL)
+#define TA1R SHIM_REG(SHIM_TA1R)
+#define TA1IV SHIM_REG(SHIM_TA1IV)
+#define TB0CTL SHIM_REG(SHIM_TB0CTL)
+#define TB0CCTL6 SHIM_REG(SHIM_TB0CCTL6)
+#define TB0CCR6 SHIM_REG(SHIM_TB0CCR6)
+#define ADC12CTL0 SHIM_REG(SHIM_ADC12CTL0)
+#define ADC12CTL1 SHIM_REG(SHIM_ADC12CTL1)
+#define ADC12CTL2 SHIM_REG(SHIM_ADC12CTL2)
+#define ADC12MCTL0 SHIM_REG(SHIM_ADC12MCTL0)
+#define ADC12MEM0 SHIM_REG(SHIM_ADC12MEM0)
+#define DMACTL0 SHIM_REG(SHIM_DMACTL0)
+#define DMA0CTL SHIM_REG(SHIM_DMA0CTL)
+#define DMA0SA SHIM_REG(SHIM_DMA0SA)
+#define DMA0DA SHIM_REG(SHIM_DMA0DA)
+#define DMA0SZ SHIM_REG(SHIM_DMA0SZ)
+#define DMAIV SHIM_REG(SHIM_DMAIV)
+#define FCTL1 SHIM_REG(SHIM_FCTL1)
+#define FCTL3 SHIM_REG(SHIM_FCTL3)
+
+// port bits
+#define BIT0 (0x0001)
+#define BIT1 (0x0002)
+#define BIT2 (0x0004)
+#define BIT3 (0x0008)
+#define BIT4 (0x0010)
+#define BIT5 (0x0020)
+#define BIT6 (0x0040)
+#define BIT7 (0x0080)
+
+// status register
+#define GIE (0x0008)
+#define CPUOFF (0x0010)
+#define OSCOFF (0x0020)
+#define SCG0 (0x0040)
+#define SCG1 (0x0080)
+#define LPM0_bits (CPUOFF)
+#define LPM3_bits (SCG1 + SCG0 + CPUOFF)
+
+// watchdog
+#define WDTPW (0x5A00)
+#define WDTHOLD (0x0080)
+
+// special function registers
+#define OFIFG (0x0002)
+
+// PMM
+#define PMMPW_H (0xA5)
+#define PMMCOREV0 (0x0001)
+#define SVSMHRRL0 (0x0001)
+#define SVSHRVL0 (0x0100)
+#define SVSHE (0x0400)
+#define SVMHE (0x4000)
+#define SVSMLRRL0 (0x0001)
+#define SVSLRVL0 (0x0100)
+#define SVSLE (0x0400)
+#define SVSLFP (0x0800)
+#define SVMLE (0x4000)
+#define SVMLFP (0x8000)
+#define SVSMLDLYIFG (0x0001)
+#define SVMLIFG (0x0002)
+#define SVMLVLRIFG (0x0004)
+
+// UCS
+#define DCO0 (0x0100)
+#define MOD0 (0x0008)
+#define DISMOD (0x0001)
+#define DCORSEL_0 (0x0000)
+#define DCORSEL_1 (0x0010)
+#define DCORSEL_2 (0x0020)
+#define DCORSEL_3 (0x0030)
+#define DCORSEL_4 (0x0040)
+#define DCORSEL_5 (0x0050)
+#define DCORSEL_6 (0x0060)
+#define DCORSEL_7 (0x0070)
+#define FLLD_0 (0x0000)
+#define FLLD_1 (0x1000)
+#define FLLD_2 (0x2000)
+#define SELREF_0 (0x0000)
+#define SELREF_2 (0x0020)
+#define FLLREFDIV_0 (0x0000)
+#define SELM_3 (0x0003)
+#define SELM_4 (0x0004)
+#define SELS_3 (0x0030)
+#define SELS_4 (0x0040)
+#define SELA_0 (0x0000)
+#define SELA_2 (0x0200)
+#define DIVM_0 (0x0000)
+#define DIVS_0 (0x0000)
+#define DIVA_0 (0x0000)
+#define DIVPA_0 (0x0000)
+#define XT1OFF (0x0001)
+#define SMCLKOFF (0x0002)
+#define XCAP_0 (0x0000)
+#define XCAP_3 (0x000C)
+#define XT1DRIVE_0 (0x0000)
+#define XT1DRIVE_3 (0x00C0)
+#define XT2OFF (0x0100)
+#define DCOFFG (0x0001)
+#define XT1LFOFFG (0x0002)
+#define XT2OFFG (0x0008)
+
+// USCI
+#define UCSYNC (0x01)
+#define UCMST (0x08)
+#define UCMSB (0x20)
+#define UCCKPL (0x40)
+#define UCCKPH (0x80)
+#define UCSWRST (0x01)
+#define UCSSEL_2 (0x80)
+#define UCRXIE (0x01)
+#define UCTXIE (0x02)
+#define UCRXIFG (0x01)
+#define UCTXIFG (0x02)
+#define UCBUSY (0x01)
+
+// Timer_A / Timer_B
+#define TAIFG (0x0001)
+#define TAIE (0x0002)
+#define TACLR (0x0004)
+#define MC_0 (0x0000)
+#define MC_1 (0x0010)
+#define MC_2 (0x0020)
+#define MC_3 (0x0030)
+#define TASSEL_1 (0x0100)
+#define TASSEL_2 (0x0200)
+#define TBCLR (0x0004)
+#define TBSSEL_1 (0x0100)
+#define TBSSEL_2 (0x0200)
+#define CCIFG (0x0001)
+#define COV (0x0002)
+#define CCIE (0x0010)
+#define OUTMOD_3 (0x0060)
+#define CAP (0x0100)
+#define SCS (0x0800)
+#define CCIS_1 (0x1000)
+#define CM_1 (0x4000)
+
+// ADC12
+#define ADC12SC (0x0001)
+#define ADC12ENC (0x0002)
+#define ADC12ON (0x0010)
+#define ADC12SHT0_2 (0x0200)
+#define ADC12CONSEQ_2 (0x0004)
+#define ADC12SHP (0x0200)
+#define ADC12SHS_1 (0x0400)
+#define ADC12RES_2 (0x0020)
+#define ADC12INCH_0 (0x0000)
+
+// DMA
+#define DMA0TSEL_24 (24)
+#define DMAIE (0x0004)
+#define DMAIFG (0x0008)
+#define DMAEN (0x0010)
+#define DMASRCINCR_0 (0x0000)
+#define DMADSTINCR_3 (0x0C00)
+#define DMADT_0 (0x0000)
+
+// flash controller
+#define FWKEY (0xA500)
+#define ERASE (0x0002)
+#define WRT (0x0040)
+#define LOCK (0x0010)
+
+// interrupt vectors, only used by #pragma vector which is ignored on the host
+#define USCI_A0_VECTOR (57)
+#define TIMER1_A1_VECTOR (48)
+#define DMA_VECTOR (50)
+
+// intrinsics
+#define __interrupt
+#define __even_in_range(value, bound) (value)
+#define __no_operation() ((void) 0)
+#define __bis_SR_register(bits) shim_bisSR(bits)
+#define __bic_SR_register(bits) shim_bicSR(bits)
+#define __bic_SR_register_on_exit(bits) shim_bicSROnExit(bits)
+#define __get_SR_register() shim_getSR()
+#define __enable_interrupt() shim_bisSR(GIE)
+#define __disable_interrupt() shim_bicSR(GIE)
+#define __delay_cycles(cycles) shim_delayCycles(cycles)
+#define __data16_write_addr(address, value) shim_writeAddress(address, value)
+
+extern void shim_bisSR(uint16_t bits);
+extern void shim_bicSR(uint16_t bits);
+extern void shim_bicSROnExit(uint16_t bits);
+extern uint16_t shim_getSR(void);
+extern void shim_delayCycles(uint32_t cycles);
+extern void shim_writeAddress(unsigned short address, unsigned long value);
+
+// Information memory, mapped to a host page that traps writes (see shim.c)
+extern uint8_t *shim_info_flash;
+
+#endif /* HOST_MSP430_H_ */
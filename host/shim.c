@@ -0,0 +1,1032 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "shim.h"
+#include "esp.h"
+
+// interrupt service routines of the firmware
+extern void USCI_A0_ISR(void);
+extern void TIMER1_A1_ISR(void);
+extern void DMA_ISR(void);
+
+// Typical DCO frequency at DCOx = 0, MODx = 0 of each DCORSEL range (datasheet fDCO(n,0)) and the ratio between taps
+static const double dco_base_hz[8] = { 0.12e6, 0.23e6, 0.49e6, 0.98e6, 2.0e6,
+                                       3.9e6, 7.0e6, 12.9e6 };
+#define DCO_TAP_RATIO 1.08
+
+// Maximum MCLK of each vcore level
+static const double vcore_max_hz[4] = { 8e6, 12e6, 20e6, 25e6 };
+
+// Active current per MHz of MCLK for each vcore level and the current in LPM3 with XT1, in mA (datasheet typical)
+static const double active_ma_per_mhz[4] = { 0.29, 0.31, 0.33, 0.37 };
+#define ACTIVE_BASE_MA 0.08
+#define FLASH_MA 3.0
+#define LPM3_MA 0.0026
+#define SVSL_FP_MA 0.0015 // low side SVS in full performance mode
+
+#define REFO_HZ 32768.0
+#define XT1_HZ 32768.0
+
+#define PMM_DELAY_NORMAL_PS 150e6 // SVS/SVM delay element in normal performance mode
+#define PMM_DELAY_FAST_PS 5e6     // ... and in full performance mode
+#define WAKEUP_SLOW_PS 150e6      // wake-up from LPM3 with the low side SVS in normal performance mode
+#define WAKEUP_FAST_PS 5e6        // ... in full performance mode or with SVS and SVM disabled
+#define FLASH_ERASE_PS 28e9       // segment erase
+#define FLASH_WRITE_PS 75e6       // byte write
+
+shim_config_t shim_config = { .xt1_startup_ms = 300, .xt1_ppm = 0,
+                              .refo_ppm = 0, .boot_offset_ns = 0 };
+
+double shim_cycles[SHIM_SUB_COUNT];
+uint32_t shim_uca0_overruns;
+uint32_t shim_uca0_lost;
+uint32_t shim_vcore_violations;
+uint32_t shim_spi_retimed;
+uint32_t shim_flash_violations;
+uint32_t shim_flash_erases;
+uint32_t shim_flash_writes;
+jmp_buf shim_power_loss;
+
+uint8_t *shim_info_flash;
+
+static volatile uint16_t regs[SHIM_REG_COUNT];
+
+// register access whose write, if any, has not been looked at yet
+static int pending_reg = -1;
+static uint16_t pending_value;
+static double pending_ps;
+
+// time and cpu
+static double now;         // ps since the last reset
+static double deadline;    // end of the current shim_run
+static double sleep_ps;
+static double charge_uc;
+static uint16_t sr;
+static uint16_t isr_sr;    // status register saved on interrupt entry
+static int isr_depth;
+static shim_sub_t sub;
+
+// clock system and pmm
+static int dcomod;         // DCOx * 32 + MODx
+static double xt1_on_ps;   // XT1 enabled at, < 0 while off
+static double aclk_next;   // next rising edge of ACLK
+static double smclk_count; // SMCLK cycles since the reset
+static unsigned vcore;
+static double pmm_ready;   // the SVS/SVM delay element expires
+static bool vcore_bad;
+
+// USCI_B0
+static shim_spi_byte_t *spi_log;
+static size_t spi_count, spi_size;
+static double tx_buffer_start; // the buffered byte moves into the shift register
+static double tx_shift_end;    // the shift register is empty
+
+// USCI_A0
+static uint8_t rx_buffer;
+static bool rx_full, rx_ifg;
+
+// timers, ADC12 and DMA0
+static uint16_t ta1_count;
+static double tb0_base;
+static double adc_next;
+static uint16_t (*adc_source)(double, void*);
+static void *adc_context;
+static uintptr_t dma_source, dma_destination;
+static uintptr_t dma_pointer;
+static uint16_t dma_left;
+
+// information memory
+static size_t page_size;
+static uint8_t flash_snapshot[SHIM_INFO_FLASH_SIZE];
+static size_t fault_offset;
+static double flash_busy;
+static long power_loss_index = -1;
+static uint32_t power_loss_seed;
+static bool power_lost;
+
+enum
+{
+    RUN, HELD, SLEEP, WAKING
+};
+
+static void settle(void);
+static void elapse(double until, int mode);
+static void dispatch(void);
+
+static inline void hwSet(shim_reg_t reg, uint16_t value)
+{
+    regs[reg] = value;
+    if (pending_reg == (int) reg)
+        pending_value = value; // not a write of the firmware
+}
+
+static inline bool xt1Stable(void)
+{
+    return xt1_on_ps >= 0 && now >= xt1_on_ps + shim_config.xt1_startup_ms * 1e9;
+}
+
+static double refoHz(void)
+{
+    return REFO_HZ * (1 + shim_config.refo_ppm * 1e-6);
+}
+
+static double xt1Hz(void)
+{
+    // the fail-safe logic uses REFO as long as the fault flag is set
+    if (regs[SHIM_UCSCTL7] & XT1LFOFFG)
+        return refoHz();
+    return XT1_HZ * (1 + shim_config.xt1_ppm * 1e-6);
+}
+
+static double dcoHz(void)
+{
+    return dco_base_hz[(regs[SHIM_UCSCTL1] >> 4) & 7]
+            * pow(DCO_TAP_RATIO, dcomod / 32.0);
+}
+
+static double sourceHz(unsigned select)
+{
+    switch (select)
+    {
+    case 0:
+        return xt1Hz();
+    case 1:
+        return 10000; // VLO
+    case 2:
+        return refoHz();
+    case 3:
+        return dcoHz();
+    default: // DCOCLKDIV, also the fail-safe source for the missing XT2
+        return dcoHz() / (1 << ((regs[SHIM_UCSCTL2] >> 12) & 7));
+    }
+}
+
+double shim_mclkHz(void)
+{
+    return sourceHz(regs[SHIM_UCSCTL4] & 7) / (1 << (regs[SHIM_UCSCTL5] & 7));
+}
+
+double shim_smclkHz(void)
+{
+    return sourceHz((regs[SHIM_UCSCTL4] >> 4) & 7)
+            / (1 << ((regs[SHIM_UCSCTL5] >> 4) & 7));
+}
+
+static double aclkHz(void)
+{
+    return sourceHz((regs[SHIM_UCSCTL4] >> 8) & 7)
+            / (1 << ((regs[SHIM_UCSCTL5] >> 8) & 7));
+}
+
+static double fllReferenceHz(void)
+{
+    static const unsigned dividers[8] = { 1, 2, 4, 8, 12, 16, 16, 16 };
+    const double reference =
+            ((regs[SHIM_UCSCTL3] >> 4) & 7) == 2 ? refoHz() : xt1Hz();
+    return reference / dividers[regs[SHIM_UCSCTL3] & 7];
+}
+
+static void updateFaults(void)
+{
+    uint16_t flags = regs[SHIM_UCSCTL7];
+    if (!xt1Stable())
+        flags |= XT1LFOFFG;
+    const int tap = dcomod >> 5;
+    if (tap == 0 || tap == 31)
+        flags |= DCOFFG;
+    hwSet(SHIM_UCSCTL7, flags);
+    if (flags & (DCOFFG + XT1LFOFFG + XT2OFFG))
+        hwSet(SHIM_SFRIFG1, regs[SHIM_SFRIFG1] | OFIFG);
+}
+
+static void checkVcore(void)
+{
+    if (shim_mclkHz() > vcore_max_hz[vcore] * 1.03)
+    {
+        if (!vcore_bad)
+        {
+            shim_vcore_violations++;
+            fprintf(stderr,
+                    "shim: MCLK %.2fMHz exceeds vcore level %u at %.3fms\n",
+                    shim_mclkHz() / 1e6, vcore, now / 1e9);
+        }
+        vcore_bad = true;
+    }
+    else
+        vcore_bad = false;
+}
+
+static double activeMa(void)
+{
+    return ACTIVE_BASE_MA + active_ma_per_mhz[vcore] * shim_mclkHz() / 1e6;
+}
+
+static void mapFlash(void)
+{
+    page_size = (size_t) sysconf(_SC_PAGESIZE);
+    shim_info_flash = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (shim_info_flash == MAP_FAILED)
+    {
+        perror("shim: mmap");
+        exit(1);
+    }
+    memset(shim_info_flash, 0xFF, page_size); // erased
+    mprotect(shim_info_flash, page_size, PROT_READ);
+}
+
+static uint8_t randomBits(void)
+{
+    power_loss_seed = power_loss_seed * 1103515245u + 12345u;
+    return (uint8_t) (power_loss_seed >> 16);
+}
+
+static bool flashOperation(void)
+{
+    if (power_loss_index < 0)
+        return true;
+    if (power_loss_index-- > 0)
+        return true;
+    power_lost = true;
+    return false;
+}
+
+// Applies the semantics of the flash to a store that has just been single-stepped
+static void flashStore(void)
+{
+    uint8_t written[SHIM_INFO_FLASH_SIZE];
+    memcpy(written, shim_info_flash, SHIM_INFO_FLASH_SIZE);
+    memcpy(shim_info_flash, flash_snapshot, SHIM_INFO_FLASH_SIZE); // nothing happens unless allowed below
+
+    const uint16_t mode = regs[SHIM_FCTL1];
+    if (power_lost)
+        return; // no supply anymore
+    if ((regs[SHIM_FCTL3] & LOCK) || !(mode & (ERASE + WRT))
+            || fault_offset >= SHIM_INFO_FLASH_SIZE)
+    {
+        shim_flash_violations++;
+        return;
+    }
+
+    if (mode & ERASE)
+    {
+        uint8_t *segment = shim_info_flash + (fault_offset & ~0x7F);
+        shim_flash_erases++;
+        flash_busy += FLASH_ERASE_PS;
+        if (flashOperation())
+            memset(segment, 0xFF, 0x80);
+        else
+        {
+            int i;
+            for (i = 0; i < 0x80; i++)
+                segment[i] |= randomBits(); // erasing sets the bits, not all of them made it
+        }
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < SHIM_INFO_FLASH_SIZE; i++)
+    {
+        if (written[i] == flash_snapshot[i] && i != fault_offset)
+            continue;
+        shim_flash_writes++;
+        flash_busy += FLASH_WRITE_PS;
+        if (!flashOperation())
+        {
+            shim_info_flash[i] &= written[i] | randomBits(); // partially programmed
+            return;
+        }
+        shim_info_flash[i] &= written[i]; // programming only clears bits
+    }
+}
+
+static void segvHandler(int signal, siginfo_t *info, void *context)
+{
+    uint8_t *address = info->si_addr;
+    if (address < shim_info_flash || address >= shim_info_flash + page_size)
+    {
+        // a real crash of the firmware or the harness
+        struct sigaction action = { .sa_handler = SIG_DFL };
+        sigaction(signal, &action, NULL);
+        return;
+    }
+    fault_offset = (size_t) (address - shim_info_flash);
+    memcpy(flash_snapshot, shim_info_flash, SHIM_INFO_FLASH_SIZE);
+    mprotect(shim_info_flash, page_size, PROT_READ | PROT_WRITE);
+    ((ucontext_t*) context)->uc_mcontext.gregs[REG_EFL] |= 0x100; // single step the store
+}
+
+static void trapHandler(int signal, siginfo_t *info, void *context)
+{
+    (void) signal;
+    (void) info;
+    ((ucontext_t*) context)->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+    flashStore();
+    mprotect(shim_info_flash, page_size, PROT_READ);
+}
+
+static void installHandlers(void)
+{
+    struct sigaction action = { .sa_flags = SA_SIGINFO };
+    sigemptyset(&action.sa_mask);
+    action.sa_sigaction = segvHandler;
+    sigaction(SIGSEGV, &action, NULL);
+    action.sa_sigaction = trapHandler;
+    sigaction(SIGTRAP, &action, NULL);
+}
+
+void shim_reset(void)
+{
+    if (!shim_info_flash)
+    {
+        mapFlash();
+        installHandlers();
+    }
+
+    memset((void*) regs, 0, sizeof(regs));
+    regs[SHIM_SFRIFG1] = OFIFG;
+    regs[SHIM_PMMIFG] = SVSMLDLYIFG;
+    regs[SHIM_UCSCTL1] = DCORSEL_2;
+    regs[SHIM_UCSCTL2] = FLLD_1 + 31; // DCOCLKDIV = 32 * 32768Hz
+    regs[SHIM_UCSCTL4] = SELA_0 + SELS_4 + SELM_4;
+    regs[SHIM_UCSCTL6] = 0xC1CD; // XT2 off, XT1 off with maximum drive and load caps
+    regs[SHIM_UCSCTL7] = DCOFFG + XT1LFOFFG + XT2OFFG;
+    regs[SHIM_UCA0CTL1] = UCSWRST;
+    regs[SHIM_UCB0CTL1] = UCSWRST;
+    regs[SHIM_UCB0IFG] = UCTXIFG;
+    regs[SHIM_FCTL1] = 0x9600;
+    regs[SHIM_FCTL3] = 0x9658; // locked
+    pending_reg = -1;
+
+    now = 0;
+    deadline = 0;
+    sleep_ps = 0;
+    charge_uc = 0;
+    sr = 0;
+    isr_depth = 0;
+    sub = SHIM_SUB_MAIN;
+    memset(shim_cycles, 0, sizeof(shim_cycles));
+
+    dcomod = 604; // 1.048576MHz DCOCLKDIV at power-up
+    regs[SHIM_UCSCTL0] = (uint16_t) (dcomod << 3);
+    xt1_on_ps = -1;
+    aclk_next = 1e12 / refoHz();
+    smclk_count = 0;
+    vcore = 0;
+    pmm_ready = 0;
+    vcore_bad = false;
+
+    spi_count = 0;
+    tx_buffer_start = -1;
+    tx_shift_end = 0;
+    rx_full = rx_ifg = false;
+    ta1_count = 0;
+    tb0_base = 0;
+    dma_source = dma_destination = dma_pointer = 0;
+    dma_left = 0;
+
+    shim_uca0_overruns = 0;
+    shim_uca0_lost = 0;
+    shim_vcore_violations = 0;
+    shim_spi_retimed = 0;
+    shim_flash_violations = 0;
+    shim_flash_erases = 0;
+    shim_flash_writes = 0;
+    flash_busy = 0;
+    power_lost = false;
+    power_loss_index = -1;
+}
+
+double shim_now_ns(void)
+{
+    return now / 1000;
+}
+
+double shim_globalNs(void)
+{
+    return now / 1000 + shim_config.boot_offset_ns;
+}
+
+unsigned shim_vcore(void)
+{
+    return vcore;
+}
+
+bool shim_isSleeping(void)
+{
+    return (sr & CPUOFF) && isr_depth == 0;
+}
+
+double shim_sleepNs(void)
+{
+    return sleep_ps / 1000;
+}
+
+double shim_chargeUC(void)
+{
+    return charge_uc;
+}
+
+bool shim_rdy(void)
+{
+    return (regs[SHIM_P1DIR] & BIT6) && (regs[SHIM_P1OUT] & BIT6);
+}
+
+const shim_spi_byte_t* shim_spiLog(size_t *count)
+{
+    *count = spi_count;
+    return spi_log;
+}
+
+void shim_spiClear(void)
+{
+    spi_count = 0;
+}
+
+double shim_spiIdleNs(void)
+{
+    return tx_shift_end / 1000;
+}
+
+void shim_setAdcSource(uint16_t (*source)(double t_ns, void *context),
+                       void *context)
+{
+    adc_source = source;
+    adc_context = context;
+}
+
+void shim_armPowerLoss(long index, uint32_t seed)
+{
+    power_loss_index = index;
+    power_loss_seed = seed;
+    power_lost = false;
+}
+
+void shim_uca0Receive(uint8_t byte)
+{
+    if ((regs[SHIM_UCA0CTL1] & UCSWRST) || !(regs[SHIM_UCA0CTL0] & UCSYNC))
+    {
+        shim_uca0_lost++;
+        return;
+    }
+    if (rx_full)
+        shim_uca0_overruns++;
+    rx_buffer = byte;
+    rx_full = true;
+    rx_ifg = true;
+}
+
+// time line
+
+static inline double cyclesToPs(double cycles)
+{
+    return cycles * 1e12 / shim_mclkHz();
+}
+
+static double espNextPs(void)
+{
+    return (esp_nextEventNs() - shim_config.boot_offset_ns) * 1000;
+}
+
+static bool adcRunning(void)
+{
+    return (regs[SHIM_TA0CTL] & MC_3) == MC_1
+            && (regs[SHIM_ADC12CTL0] & (ADC12ON + ADC12ENC))
+                    == ADC12ON + ADC12ENC
+            && (regs[SHIM_ADC12CTL1] & ADC12SHS_1) && !(sr & SCG1);
+}
+
+static void adcSample(void)
+{
+    const uint16_t value =
+            adc_source ? adc_source(now / 1000, adc_context) & 0x0FFF : 2048;
+    hwSet(SHIM_ADC12MEM0, value);
+
+    if ((regs[SHIM_DMA0CTL] & DMAEN) && (regs[SHIM_DMACTL0] & 0x1F) == 24
+            && dma_left)
+    {
+        *(uint16_t*) dma_pointer = value;
+        dma_pointer += 2;
+        if (--dma_left == 0)
+            hwSet(SHIM_DMA0CTL, (regs[SHIM_DMA0CTL] & ~DMAEN) | DMAIFG);
+    }
+    adc_next += (regs[SHIM_TA0CCR0] + 1) * 1e12 / shim_smclkHz();
+}
+
+static void aclkEdge(void)
+{
+    aclk_next += 1e12 / aclkHz();
+
+    // Timer_A1 in continuous mode on ACLK
+    if ((regs[SHIM_TA1CTL] & MC_3) == MC_2 && (regs[SHIM_TA1CTL] & 0x0300) == TASSEL_1)
+    {
+        if (++ta1_count == 0)
+            hwSet(SHIM_TA1CTL, regs[SHIM_TA1CTL] | TAIFG);
+    }
+
+    // Timer_B0 capturing ACLK (CCI6B) while counting SMCLK
+    const uint16_t capture = regs[SHIM_TB0CCTL6];
+    if ((regs[SHIM_TB0CTL] & MC_3) && (capture & (CAP + CCIS_1 + CM_1)) == CAP + CCIS_1 + CM_1)
+    {
+        hwSet(SHIM_TB0CCR6, (uint16_t) (uint32_t) (smclk_count - tb0_base));
+        hwSet(SHIM_TB0CCTL6, capture | CCIFG | (capture & CCIFG ? COV : 0));
+    }
+
+    // one FLL step per reference period (the reference runs at the same rate as ACLK)
+    if (!(sr & SCG0))
+    {
+        const double target = ((regs[SHIM_UCSCTL2] & 0x3FF) + 1) * fllReferenceHz();
+        const double dcodiv = dcoHz() / (1 << ((regs[SHIM_UCSCTL2] >> 12) & 7));
+        if (dcodiv < target && dcomod < 1023)
+            dcomod++;
+        else if (dcodiv > target && dcomod > 0)
+            dcomod--;
+        hwSet(SHIM_UCSCTL0, (uint16_t) (dcomod << 3));
+        checkVcore();
+    }
+    updateFaults();
+}
+
+// Skips the ACLK edges before 'until' that only count Timer_A1, e.g. while the CPU sleeps in LPM3
+static void skipAclkEdges(double until)
+{
+    if (!(sr & SCG0) || (regs[SHIM_TB0CTL] & MC_3))
+        return; // the FLL or the capture of Timer_B0 needs every edge
+    if (xt1_on_ps >= 0 && !xt1Stable())
+        until = fmin(until, xt1_on_ps + shim_config.xt1_startup_ms * 1e9); // ACLK changes to XT1
+
+    const double period = 1e12 / aclkHz();
+    double edges = floor((until - aclk_next) / period) - 1; // the last edge is left to aclkEdge
+    const bool ta1 = (regs[SHIM_TA1CTL] & MC_3) == MC_2
+            && (regs[SHIM_TA1CTL] & 0x0300) == TASSEL_1;
+    if (ta1 && edges > 0xFFFF - ta1_count)
+        edges = 0xFFFF - ta1_count; // the overflow sets TAIFG in aclkEdge
+    if (edges < 1)
+        return;
+
+    aclk_next += edges * period;
+    if (ta1)
+        ta1_count += (uint16_t) edges;
+}
+
+static void account(double dt, int mode)
+{
+    if (dt <= 0)
+        return;
+    if (mode == RUN || mode == HELD)
+    {
+        shim_cycles[mode == HELD ? SHIM_SUB_FLASH : sub] += dt * 1e-12
+                * shim_mclkHz();
+        smclk_count += dt * 1e-12 * shim_smclkHz();
+        charge_uc += (activeMa() + (mode == HELD ? FLASH_MA : 0)) * dt * 1e-9;
+    }
+    else
+    {
+        sleep_ps += dt;
+        charge_uc += (LPM3_MA + (regs[SHIM_SVSMLCTL] & SVSLFP ? SVSL_FP_MA : 0))
+                * dt * 1e-9;
+    }
+}
+
+static void elapse(double until, int mode)
+{
+    while (now < until)
+    {
+        if (mode == SLEEP)
+            skipAclkEdges(fmin(until, espNextPs()));
+        double next = until;
+        if (aclk_next < next)
+            next = aclk_next;
+        const double esp = espNextPs();
+        if (esp < next)
+            next = esp;
+        if (mode != SLEEP && mode != WAKING && adcRunning() && adc_next < next)
+            next = adc_next;
+        if (next < now)
+            next = now;
+
+        account(next - now, mode);
+        now = next;
+
+        if (now >= aclk_next)
+            aclkEdge();
+        if (espNextPs() <= now)
+            esp_event();
+        if (mode != SLEEP && mode != WAKING && adcRunning() && adc_next <= now)
+            adcSample();
+
+        if (mode == RUN || mode == SLEEP)
+        {
+            const double before = now;
+            dispatch();
+            if (mode == RUN)
+                until += now - before; // the interrupted code still needs its time
+            else if (!(sr & CPUOFF))
+                return; // woken up
+        }
+    }
+}
+
+static bool uca0Pending(void)
+{
+    return rx_ifg && (regs[SHIM_UCA0IE] & UCRXIE);
+}
+
+static bool dmaPending(void)
+{
+    return (regs[SHIM_DMA0CTL] & (DMAIFG + DMAIE)) == DMAIFG + DMAIE;
+}
+
+static bool ta1Pending(void)
+{
+    return (regs[SHIM_TA1CTL] & (TAIFG + TAIE)) == TAIFG + TAIE;
+}
+
+static void dispatch(void)
+{
+    while ((sr & GIE) && isr_depth == 0)
+    {
+        void (*isr)(void);
+        shim_sub_t isr_sub;
+        if (uca0Pending())
+        {
+            isr = USCI_A0_ISR;
+            isr_sub = SHIM_SUB_ISR_USCI_A0;
+        }
+        else if (dmaPending())
+        {
+            isr = DMA_ISR;
+            isr_sub = SHIM_SUB_ISR_DMA;
+        }
+        else if (ta1Pending())
+        {
+            isr = TIMER1_A1_ISR;
+            isr_sub = SHIM_SUB_ISR_TIMER1;
+        }
+        else
+            break;
+
+        isr_depth++;
+        if (sr & CPUOFF)
+        {
+            // wake-up from LPM3, slow with the low side supervisor in normal performance mode
+            const uint16_t svsml = regs[SHIM_SVSMLCTL];
+            const bool slow = (svsml & (SVSLE + SVMLE)) && !(svsml & SVSLFP);
+            elapse(now + (slow ? WAKEUP_SLOW_PS : WAKEUP_FAST_PS), WAKING);
+        }
+        isr_sr = sr;
+        sr &= SCG0; // the status register is cleared except SCG0
+        const shim_sub_t interrupted = sub;
+        sub = isr_sub;
+        elapse(now + cyclesToPs(SHIM_CYCLES_ISR_ENTRY), RUN);
+        isr();
+        settle();
+        elapse(now + cyclesToPs(SHIM_CYCLES_ISR_EXIT), RUN);
+        sub = interrupted;
+        sr = isr_sr;
+        isr_depth--;
+        checkVcore();
+    }
+}
+
+// register model
+
+static void xt1Check(void)
+{
+    const bool on = !(regs[SHIM_UCSCTL6] & XT1OFF)
+            && (regs[SHIM_P5SEL] & (BIT4 + BIT5)) == BIT4 + BIT5;
+    if (on && xt1_on_ps < 0)
+        xt1_on_ps = now;
+    else if (!on)
+        xt1_on_ps = -1;
+}
+
+static void transmit(uint8_t value, double at)
+{
+    if (regs[SHIM_UCB0CTL1] & UCSWRST)
+        return;
+    const double bit = ((regs[SHIM_UCB0BR1] << 8) + regs[SHIM_UCB0BR0])
+            * 1e12 / shim_smclkHz();
+    const double start = at > tx_shift_end ? at : tx_shift_end;
+
+    if (spi_count == spi_size)
+    {
+        spi_size = spi_size ? spi_size * 2 : 4096;
+        spi_log = realloc(spi_log, spi_size * sizeof(*spi_log));
+    }
+    spi_log[spi_count++] = (shim_spi_byte_t ) { .value = value, .start_ns =
+                                                        start / 1000,
+                                                .bit_ns = bit / 1000 };
+    tx_buffer_start = start;
+    tx_shift_end = start + 8 * bit;
+}
+
+// The bit time of a byte is fixed when it is written to UCB0TXBUF, a DCO that changes under it is only counted
+static void spiRetimed(double at)
+{
+    if (!(regs[SHIM_UCB0CTL1] & UCSWRST) && at < tx_shift_end)
+        shim_spi_retimed++;
+}
+
+static void onWrite(shim_reg_t reg, uint16_t value, double at)
+{
+    switch (reg)
+    {
+    case SHIM_UCSCTL0:
+        spiRetimed(at);
+        dcomod = (value >> 3) & 0x3FF;
+        updateFaults();
+        checkVcore();
+        break;
+    case SHIM_UCSCTL1:
+    case SHIM_UCSCTL2:
+        spiRetimed(at);
+        checkVcore();
+        break;
+    case SHIM_UCSCTL4:
+    case SHIM_UCSCTL5:
+        checkVcore();
+        break;
+    case SHIM_UCSCTL6:
+    case SHIM_P5SEL:
+        xt1Check();
+        break;
+    case SHIM_UCSCTL7:
+    case SHIM_SFRIFG1:
+        updateFaults(); // flags of faults that persist are set again
+        break;
+    case SHIM_SVSMLCTL:
+        hwSet(SHIM_PMMIFG, regs[SHIM_PMMIFG] & ~SVSMLDLYIFG);
+        pmm_ready = now + (value & SVSLFP ? PMM_DELAY_FAST_PS : PMM_DELAY_NORMAL_PS);
+        break;
+    case SHIM_PMMCTL0_L:
+        if (regs[SHIM_PMMCTL0_H] == PMMPW_H)
+        {
+            vcore = value & 3;
+            checkVcore();
+        }
+        break;
+    case SHIM_UCB0TXBUF:
+        transmit((uint8_t) value, at);
+        break;
+    case SHIM_UCB0CTL1:
+        if (value & UCSWRST)
+            tx_buffer_start = -1;
+        break;
+    case SHIM_TA1CTL:
+        if (value & TACLR)
+        {
+            ta1_count = 0;
+            hwSet(SHIM_TA1CTL, value & ~TACLR);
+        }
+        break;
+    case SHIM_TA0CTL:
+        if ((value & MC_3) == MC_1)
+            adc_next = now + (regs[SHIM_TA0CCR1] + 1) * 1e12 / shim_smclkHz();
+        hwSet(SHIM_TA0CTL, value & ~TACLR);
+        break;
+    case SHIM_TB0CTL:
+        if (value & TBCLR)
+        {
+            tb0_base = smclk_count;
+            hwSet(SHIM_TB0CTL, value & ~TBCLR);
+        }
+        break;
+    case SHIM_DMA0CTL:
+        if ((value & DMAEN) && !(pending_value & DMAEN))
+        {
+            dma_pointer = dma_destination;
+            dma_left = regs[SHIM_DMA0SZ];
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void settle(void)
+{
+    if (pending_reg < 0)
+        return;
+    const shim_reg_t reg = (shim_reg_t) pending_reg;
+    const uint16_t value = regs[reg];
+    const bool written = reg == SHIM_UCB0TXBUF ? value != 0xFFFF : value != pending_value;
+    if (written)
+        onWrite(reg, value, pending_ps);
+    pending_reg = -1;
+}
+
+static void flashSettle(void)
+{
+    if (flash_busy > 0)
+    {
+        const double busy = flash_busy;
+        flash_busy = 0;
+        elapse(now + busy, HELD); // the CPU is held while the flash controller is busy
+    }
+    if (power_lost)
+    {
+        power_lost = false;
+        power_loss_index = -1;
+        longjmp(shim_power_loss, 1);
+    }
+}
+
+static void wait(double until, shim_sub_t wait_sub)
+{
+    const shim_sub_t waiting = sub;
+    if (isr_depth == 0)
+        sub = wait_sub;
+    elapse(until, RUN);
+    sub = waiting;
+}
+
+static void onAccess(shim_reg_t reg)
+{
+    switch (reg)
+    {
+    case SHIM_SFRIFG1:
+    case SHIM_UCSCTL7:
+        updateFaults();
+        break;
+    case SHIM_PMMIFG:
+        if (!(regs[SHIM_PMMIFG] & SVSMLDLYIFG))
+        {
+            if (now < pmm_ready)
+                wait(pmm_ready, SHIM_SUB_CLOCK_WAIT);
+            hwSet(SHIM_PMMIFG, regs[SHIM_PMMIFG] | SVSMLDLYIFG);
+        }
+        break;
+    case SHIM_UCB0IFG:
+        if (tx_buffer_start > now)
+            wait(tx_buffer_start, SHIM_SUB_SPI_WAIT); // the buffered byte has not moved on yet
+        hwSet(SHIM_UCB0IFG, UCTXIFG);
+        break;
+    case SHIM_UCB0TXBUF:
+        hwSet(SHIM_UCB0TXBUF, 0xFFFF); // no 8-bit write can produce this
+        break;
+    case SHIM_UCB0STAT:
+        hwSet(SHIM_UCB0STAT, !(regs[SHIM_UCB0CTL1] & UCSWRST) && now < tx_shift_end ? UCBUSY : 0);
+        break;
+    case SHIM_UCA0IV:
+        if (uca0Pending())
+        {
+            rx_ifg = false;
+            hwSet(SHIM_UCA0IV, 2);
+        }
+        else
+            hwSet(SHIM_UCA0IV, 0);
+        break;
+    case SHIM_UCA0RXBUF:
+        rx_full = false;
+        rx_ifg = false;
+        hwSet(SHIM_UCA0RXBUF, rx_buffer);
+        break;
+    case SHIM_TA1R:
+        hwSet(SHIM_TA1R, ta1_count);
+        break;
+    case SHIM_TA1IV:
+        if (ta1Pending())
+        {
+            hwSet(SHIM_TA1CTL, regs[SHIM_TA1CTL] & ~TAIFG);
+            hwSet(SHIM_TA1IV, 14);
+        }
+        else
+            hwSet(SHIM_TA1IV, 0);
+        break;
+    case SHIM_DMAIV:
+        if (dmaPending())
+        {
+            hwSet(SHIM_DMA0CTL, regs[SHIM_DMA0CTL] & ~DMAIFG);
+            hwSet(SHIM_DMAIV, 2);
+        }
+        else
+            hwSet(SHIM_DMAIV, 0);
+        break;
+    case SHIM_TB0CCTL6:
+        if ((regs[SHIM_TB0CTL] & MC_3)
+                && (regs[SHIM_TB0CCTL6] & (CAP + CCIS_1 + CM_1 + CCIFG))
+                        == CAP + CCIS_1 + CM_1)
+            wait(aclk_next, SHIM_SUB_CLOCK_WAIT); // the capture happens at the next edge of ACLK
+        break;
+    default:
+        break;
+    }
+}
+
+volatile uint16_t* shim_reg(shim_reg_t reg)
+{
+    settle();
+    flashSettle();
+    elapse(now + cyclesToPs(SHIM_CYCLES_PER_ACCESS), RUN);
+    settle();
+    onAccess(reg);
+
+    pending_reg = reg;
+    pending_value = regs[reg];
+    pending_ps = now;
+    return &regs[reg];
+}
+
+// intrinsics
+
+void shim_bisSR(uint16_t bits)
+{
+    settle();
+    flashSettle();
+    sr |= bits;
+    dispatch();
+    while (sr & CPUOFF)
+    {
+        if (now >= deadline)
+        {
+            sr &= ~LPM3_bits; // end of the run, nothing would wake the CPU up in time
+            break;
+        }
+        elapse(deadline, SLEEP);
+    }
+    checkVcore();
+}
+
+void shim_bicSR(uint16_t bits)
+{
+    settle();
+    sr &= ~bits;
+    checkVcore();
+}
+
+void shim_bicSROnExit(uint16_t bits)
+{
+    if (isr_depth > 0)
+        isr_sr &= ~bits;
+}
+
+uint16_t shim_getSR(void)
+{
+    return sr;
+}
+
+void shim_delayCycles(uint32_t cycles)
+{
+    shim_charge(sub, cycles);
+}
+
+void shim_writeAddress(unsigned short address, unsigned long value)
+{
+    settle();
+    elapse(now + cyclesToPs(SHIM_CYCLES_PER_ACCESS), RUN);
+    if (address == (unsigned short) (uintptr_t) &regs[SHIM_DMA0SA])
+        dma_source = (uintptr_t) value;
+    else if (address == (unsigned short) (uintptr_t) &regs[SHIM_DMA0DA])
+        dma_destination = (uintptr_t) value;
+}
+
+// harness
+
+void shim_charge(shim_sub_t charged, double cycles)
+{
+    settle();
+    flashSettle();
+    const shim_sub_t charging = sub;
+    if (isr_depth == 0)
+        sub = charged;
+    elapse(now + cyclesToPs(cycles), RUN);
+    sub = charging;
+}
+
+void shim_stop(void)
+{
+    deadline = now;
+}
+
+void shim_run(void (*loop)(void), double until_ns)
+{
+    deadline = until_ns * 1000;
+    while (now < deadline)
+    {
+        loop();
+        shim_charge(SHIM_SUB_MAIN, SHIM_CYCLES_LOOP);
+    }
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Model of the MSP430F5529 behind host/msp430.h.
+ *
+ * Time only advances when the firmware touches the hardware: every register access costs
+ * SHIM_CYCLES_PER_ACCESS MCLK cycles, polling loops jump to the event they wait for and code without
+ * register accesses is charged by the cycle model (cycle-model.h). Interrupts are injected between
+ * register accesses as soon as they are pending and enabled.
+ *
+ * Modelled: UCS (DCO taps, FLL, XT1 start-up and REFO fallback, fault flags), PMM vcore levels,
+ * USCI_B0 SPI master output, USCI_A0 SPI slave input, Timer_A1 on ACLK, Timer_A0 triggering ADC12 into DMA0,
+ * Timer_B0 capturing ACLK, the information memory with the flash controller, LPM3 and the supply current.
+ */
+
+#ifndef HOST_SHIM_H_
+#define HOST_SHIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <msp430.h>
+
+#define SHIM_CYCLES_PER_ACCESS 4  // average of the MSP430X absolute addressing instructions
+#define SHIM_CYCLES_ISR_ENTRY 6   // interrupt acceptance
+#define SHIM_CYCLES_ISR_EXIT 5    // RETI
+#define SHIM_CYCLES_LOOP 20       // one pass of the main loop without any register access
+
+#define SHIM_INFO_FLASH_SIZE 0x200 // information memory D, C, B and A
+
+// Subsystems the cycles are accounted to
+typedef enum
+{
+    SHIM_SUB_MAIN,        // main loop and everything not listed below
+    SHIM_SUB_ENCODE,      // colors encoded for the strip (cycle model)
+    SHIM_SUB_SPECTRUM,    // goertzel filter bank (cycle model)
+    SHIM_SUB_SPI_WAIT,    // waiting for USCI_B0 to accept the next byte
+    SHIM_SUB_CLOCK_WAIT,  // waiting for the PMM or the clock system
+    SHIM_SUB_FLASH,       // CPU held by the flash controller
+    SHIM_SUB_ISR_USCI_A0, // MESP receive interrupt
+    SHIM_SUB_ISR_TIMER1,  // timebase interrupt
+    SHIM_SUB_ISR_DMA,     // sample block interrupt
+    SHIM_SUB_COUNT
+} shim_sub_t;
+
+// One byte shifted out by USCI_B0
+typedef struct
+{
+    uint8_t value;
+    double start_ns; // first bit on the wire
+    double bit_ns;   // duration of one bit
+} shim_spi_byte_t;
+
+typedef struct
+{
+    double xt1_startup_ms; // time from enabling XT1 until it oscillates stably
+    double xt1_ppm;        // frequency error of the crystal
+    double refo_ppm;       // frequency error of REFO, the datasheet allows +-3.5% over temperature
+    double boot_offset_ns; // reset of this device on the global time line (for several devices)
+} shim_config_t;
+
+extern shim_config_t shim_config;
+
+// counters of the run
+extern double shim_cycles[SHIM_SUB_COUNT]; // MCLK cycles per subsystem
+extern uint32_t shim_uca0_overruns;        // bytes that overwrote an unread byte
+extern uint32_t shim_uca0_lost;            // bytes sent while USCI_A0 was in reset
+extern uint32_t shim_vcore_violations;     // MCLK above the limit of the vcore level
+extern uint32_t shim_spi_retimed;          // DCO reconfigured while USCI_B0 was shifting out a byte
+extern uint32_t shim_flash_violations;     // flash written while locked or without WRT/ERASE
+extern uint32_t shim_flash_erases;
+extern uint32_t shim_flash_writes;
+extern jmp_buf shim_power_loss;            // target of a simulated power loss, see shim_armPowerLoss
+
+/**
+ * This function resets the model to its power-up state. The firmware's variables are not touched,
+ * a test that reboots has to run in a fresh process (see skew test) or only reboot modules that reinitialise.
+ * The information memory keeps its contents like a real flash.
+ */
+extern void shim_reset(void);
+
+/**
+ * This function runs 'loop' until the simulated time reaches 'until_ns'. When the firmware sleeps
+ * and nothing is left to wake it up before 'until_ns', it is woken up at 'until_ns'.
+ */
+extern void shim_run(void (*loop)(void), double until_ns);
+
+/**
+ * This function ends the current shim_run after the running pass of the loop.
+ */
+extern void shim_stop(void);
+
+/**
+ * This function charges cycles of code without register accesses to a subsystem.
+ */
+extern void shim_charge(shim_sub_t sub, double cycles);
+
+extern double shim_now_ns(void);       // time since the last reset
+extern double shim_globalNs(void);      // time on the global time line
+extern double shim_mclkHz(void);
+extern double shim_smclkHz(void);
+extern unsigned shim_vcore(void);
+extern bool shim_isSleeping(void);
+extern double shim_sleepNs(void);      // time spent in LPM3
+extern double shim_chargeUC(void);     // charge drawn by the MSP430 in uC
+extern bool shim_rdy(void);            // RDY line of the MESP link
+
+// USCI_B0 output
+extern const shim_spi_byte_t* shim_spiLog(size_t *count);
+extern void shim_spiClear(void);
+extern double shim_spiIdleNs(void);    // time the last byte has left the shift register
+
+// USCI_A0 input, used by the ESP model
+extern void shim_uca0Receive(uint8_t byte);
+
+// ADC12 input at A0, 12-bit value at the given time
+extern void shim_setAdcSource(uint16_t (*source)(double t_ns, void *context), void *context);
+
+/**
+ * This function arms a power loss. The 'index'th flash operation (erase or byte write) from now on is
+ * interrupted and the next register access jumps to shim_power_loss. Pass -1 to disarm.
+ */
+extern void shim_armPowerLoss(long index, uint32_t seed);
+
+#endif /* HOST_SHIM_H_ */
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * The bytes each led chip gets for a strip of distinct colors, built once per chip configuration (see Makefile).
+ * WS2812B and SK6812 are checked on the decoded data line, APA102 and SK9822 on the raw SPI bytes.
+ * The expected order of the colors is the order of the chip's datasheet unless the build selects another one.
+ */
+
+// Taken from the command line before ws2812b.h picks the default of the chip
+#if defined(WS2812B_ORDER_RGB)
+#define EXPECTED_ORDER { 0, 1, 2 }
+#elif defined(WS2812B_ORDER_BGR) || defined(WS2812B_CHIP_APA102) || defined(WS2812B_CHIP_SK9822)
+#define EXPECTED_ORDER { 2, 1, 0 }
+#else
+#define EXPECTED_ORDER { 1, 0, 2 }
+#endif
+
+#include <math.h>
+#include <string.h>
+#include "shim.h"
+#include "esp.h"
+#include "ws2812b-decoder.h"
+#include "ws2812b.h"
+#include "test.h"
+
+#define WS2812B_BIT_NS 200.0 // 25MHz / 5
+#define APA102_BIT_NS (WS2812B_APA102_CLOCK_DIVIDER * 40.0)
+
+static const uint8_t order[3] = EXPECTED_ORDER; // wire position -> red, green, blue
+
+// The colors of led 'i': red, green, blue and white
+static void color(uint16_t i, uint8_t rgbw[4])
+{
+    rgbw[0] = (uint8_t) (3 * i + 1);
+    rgbw[1] = (uint8_t) (5 * i + 2);
+    rgbw[2] = (uint8_t) (7 * i + 3);
+    rgbw[3] = (uint8_t) (11 * i + 4);
+}
+
+// Returns the number of bytes of the expected stream of the leds
+static size_t expectedLeds(uint8_t *bytes)
+{
+    size_t count = 0;
+    uint16_t i;
+    for (i = 0; i < WS2812B_LED_COUNT; i++)
+    {
+        uint8_t rgbw[4];
+        color(i, rgbw);
+#ifdef WS2812B_CHIP_APA102
+        bytes[count++] = 0xE0 | WS2812B_APA102_BRIGHTNESS;
+#endif
+        uint8_t c;
+        for (c = 0; c < 3; c++)
+            bytes[count++] = rgbw[order[c]];
+#if WS2812B_CHANNEL_COUNT == 4
+        bytes[count++] = rgbw[3];
+#endif
+    }
+    return count;
+}
+
+static void idle(void)
+{
+}
+
+static void checkBits(double bit_ns)
+{
+    size_t count, i;
+    const shim_spi_byte_t *log = shim_spiLog(&count);
+    CHECK(count > 0, "nothing has been sent");
+    for (i = 0; i < count; i++)
+        if (fabs(log[i].bit_ns - bit_ns) > 1)
+        {
+            CHECK(false, "byte %zu: bit of %.1fns, expected %.1fns", i, log[i].bit_ns, bit_ns);
+            break;
+        }
+}
+
+int main(void)
+{
+    shim_reset();
+    esp_reset(); // nothing to send
+    ws2812b_initClockTo25MHz();
+    ws2812b_initSPI();
+
+    uint16_t i;
+    for (i = 0; i < WS2812B_LED_COUNT; i++)
+    {
+        uint8_t rgbw[4];
+        color(i, rgbw);
+        ws2812b_setLEDColor(i, rgbw[0], rgbw[1], rgbw[2]);
+#if WS2812B_CHANNEL_COUNT == 4
+        ws2812b_setLEDWhite(i, rgbw[3]);
+#endif
+    }
+    CHECK(ws2812b_estimateCurrent() <= WS2812B_POWER_BUDGET_MA, "the limiter would scale the colors");
+    ws2812b_showStrip();
+    shim_run(&idle, shim_now_ns() + 1e6); // the last byte has left the shift register
+
+    uint8_t expected[4 + 4 * WS2812B_LED_COUNT + 4 + WS2812B_LED_COUNT / 16 + 1];
+#ifdef WS2812B_CHIP_APA102
+    size_t count = 0, j;
+    memset(expected, 0, 4); // start frame
+    count += 4;
+    const size_t led_bytes = expectedLeds(expected + count);
+    count += led_bytes;
+    const size_t end = 4 + (WS2812B_LED_COUNT + 15) / 16; // end frame
+    memset(expected + count, 0, end);
+    count += end;
+
+    size_t sent;
+    const shim_spi_byte_t *log = shim_spiLog(&sent);
+    CHECK(sent == count, "%zu bytes sent, expected %zu", sent, count);
+    for (j = 0; j < sent && j < count; j++)
+        if (log[j].value != expected[j])
+        {
+            CHECK(false, "byte %zu is 0x%02x, expected 0x%02x", j, log[j].value, expected[j]);
+            break;
+        }
+    checkBits(APA102_BIT_NS);
+    CHECK((P3SEL & (BIT0 + BIT2)) == BIT0 + BIT2, "data and clock are not routed to USCI_B0");
+#else
+    const size_t led_bytes = expectedLeds(expected), count = led_bytes;
+    decoder_result_t wire;
+    decoder_decodeStrip(&wire);
+    CHECK(wire.count == 1 && wire.errors == 0, "%zu frames, %s", wire.count, wire.error);
+    if (wire.count == 1)
+    {
+        CHECK(wire.frames[0].latched, "the frame has not latched");
+        CHECK(wire.frames[0].length == count, "%zu bytes on the strip, expected %zu",
+              wire.frames[0].length, count);
+        CHECK(memcmp(wire.frames[0].bytes, expected, count) == 0,
+              "the colors are not in the order of the chip");
+    }
+    decoder_free(&wire);
+    checkBits(WS2812B_BIT_NS);
+    CHECK((P3SEL & (BIT0 + BIT2)) == BIT0, "the data line is not routed to USCI_B0 alone");
+#endif
+
+    printf("%s, %u channels, order %c%c%c: %zu bytes of leds\n",
+#if defined(WS2812B_CHIP_SK9822)
+           "SK9822",
+#elif defined(WS2812B_CHIP_APA102)
+           "APA102",
+#elif defined(WS2812B_CHIP_SK6812_RGBW)
+           "SK6812",
+#else
+           "WS2812B",
+#endif
+           WS2812B_CHANNEL_COUNT, "RGB"[order[0]], "RGB"[order[1]], "RGB"[order[2]],
+           led_bytes);
+
+    return test_result("test-chip");
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Bring-up of the clock from reset to the first frame on the strip showing the color of a frame the ESP sends
+ * 1ms after the reset, for an XT1 that starts quickly, one that takes 300ms and one that never starts.
+ * Each scenario boots in its own process.
+ *
+ * The vcore has to be raised before MCLK, the power-up frame must only be sent once the FLL has locked
+ * (every bit 200ns at 25MHz / 5) and a frame the ESP sends during the bring-up must not be lost.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "shim.h"
+#include "esp.h"
+#include "ws2812b-decoder.h"
+#include "mesp-ws2812b.h"
+#include "ws2812b.h"
+#include "test.h"
+
+#define MS 1e6
+#define BIT_NS 200.0 // SMCLK / 5
+#define BIT_TOLERANCE_NS 2.0
+
+typedef struct
+{
+    double first_frame_ns;    // reset to the first rising edge on the strip, the power-up frame
+    double accepted_frame_ns; // reset to the first frame showing the color of the ESP
+    double bit_min_ns, bit_max_ns;
+    double mclk_hz;
+} clock_result_t;
+
+static void bringUp(void *result, const void *argument)
+{
+    clock_result_t *clock = result;
+    shim_config.xt1_startup_ms = *(const double*) argument;
+    shim_reset();
+    esp_reset();
+
+    const uint8_t color[3] = { 0x40, 0x20, 0x10 };
+    const int frame = esp_send(MESP_WS2812B_CMD_SINGLE, color, sizeof(color),
+                               1 * MS); // while the FLL is still searching
+    mespWS2812B_init();
+    mespWS2812B_enable();
+    shim_run(mespWS2812B_loop, 1000 * MS);
+
+    clock->mclk_hz = shim_mclkHz();
+    size_t count;
+    const shim_spi_byte_t *log = shim_spiLog(&count);
+    clock->bit_min_ns = INFINITY;
+    clock->bit_max_ns = 0;
+    size_t i;
+    for (i = 0; i < count; i++)
+    {
+        clock->bit_min_ns = fmin(clock->bit_min_ns, log[i].bit_ns);
+        clock->bit_max_ns = fmax(clock->bit_max_ns, log[i].bit_ns);
+    }
+
+    decoder_result_t wire;
+    decoder_decodeStrip(&wire);
+    CHECK(wire.errors == 0, "%s", wire.error);
+    CHECK(wire.count >= 2, "%zu frames on the strip", wire.count);
+    clock->first_frame_ns = wire.count ? wire.frames[0].start_ns : NAN;
+    clock->accepted_frame_ns = NAN;
+    for (i = 0; i < wire.count && isnan(clock->accepted_frame_ns); i++)
+        if (wire.frames[i].length == 3 * WS2812B_LED_COUNT && wire.frames[i].bytes[0] == 0x20
+                && wire.frames[i].bytes[1] == 0x40 && wire.frames[i].bytes[2] == 0x10)
+            clock->accepted_frame_ns = wire.frames[i].start_ns;
+    CHECK(!isnan(clock->accepted_frame_ns), "the frame sent during the bring-up has not been shown");
+    decoder_free(&wire);
+
+    CHECK(!isnan(esp_endNs(frame)), "the frame has not been sent");
+    CHECK(shim_uca0_overruns == 0 && shim_uca0_lost == 0,
+          "%u bytes overran, %u lost", shim_uca0_overruns, shim_uca0_lost);
+    CHECK(shim_vcore_violations == 0, "MCLK too fast for the vcore");
+}
+
+int main(void)
+{
+    const double startups_ms[] = { 1, 300, INFINITY };
+    unsigned i;
+    for (i = 0; i < sizeof(startups_ms) / sizeof(startups_ms[0]); i++)
+    {
+        clock_result_t clock;
+        memset(&clock, 0, sizeof(clock));
+        const bool passed = test_fork(&bringUp, &startups_ms[i], &clock,
+                                      sizeof(clock));
+        printf("xt1 start-up %5.0fms: reset to power-up frame %6.2fms, to the ESP's frame %6.2fms, bits %.1f-%.1fns%s\n",
+               startups_ms[i], clock.first_frame_ns / MS, clock.accepted_frame_ns / MS, clock.bit_min_ns,
+               clock.bit_max_ns, passed ? "" : " (failed)");
+        if (!passed)
+            continue;
+        CHECK(clock.bit_min_ns >= BIT_NS - BIT_TOLERANCE_NS
+                      && clock.bit_max_ns <= BIT_NS + BIT_TOLERANCE_NS,
+              "xt1 %.0fms: bits of %.1f-%.1fns on the strip, FLL not locked",
+              startups_ms[i], clock.bit_min_ns, clock.bit_max_ns);
+        CHECK(clock.accepted_frame_ns < 20 * MS,
+              "xt1 %.0fms: the ESP's frame shown after %.2fms", startups_ms[i],
+              clock.accepted_frame_ns / MS);
+    }
+    return test_result("test-clock");
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Sleeping while the strip is static: the time from the start code of a frame that wakes the lamp up to the
+ * first refresh of the strip, and the average current of the MSP430 while idle and at one frame per second.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "shim.h"
+#include "esp.h"
+#include "ws2812b-decoder.h"
+#include "mesp-ws2812b.h"
+#include "ws2812b.h"
+#include "cycle-model.h"
+#include "test.h"
+
+#define MS 1e6
+#define WAKES 10
+#define MAX_WAKE_MS 0.25      // start code to the first edge on the strip, beyond receiving and encoding the frame
+#define MAX_IDLE_MA 0.05      // LPM3 with XT1 (or REFO) and the timebase
+#define MAX_ONE_FPS_MA 0.2    // one SINGLE frame per second
+
+// Average current from the charge drawn since 'charge_uc' at 'since_ns'
+static double averageMa(double charge_uc, double since_ns)
+{
+    return (shim_chargeUC() - charge_uc) * 1e-3 / ((shim_now_ns() - since_ns) * 1e-9);
+}
+
+int main(void)
+{
+    shim_reset();
+    esp_reset();
+    mespWS2812B_init();
+    mespWS2812B_enable();
+    shim_run(mespWS2812B_loop, 500 * MS); // XT1 has started, the lamp sleeps
+
+    double since_ns = shim_now_ns();
+    double charge_uc = shim_chargeUC();
+    shim_run(mespWS2812B_loop, since_ns + 1000 * MS);
+    const double idle_ma = averageMa(charge_uc, since_ns);
+
+    since_ns = shim_now_ns();
+    charge_uc = shim_chargeUC();
+    double worst_ms = 0, sum_ms = 0;
+    unsigned i;
+    for (i = 0; i < WAKES; i++)
+    {
+        const uint8_t color[3] = { (uint8_t) i, 0x80, 0x40 };
+        shim_spiClear();
+        const double second_ns = shim_now_ns();
+        const int frame = esp_send(MESP_WS2812B_CMD_SINGLE, color, sizeof(color),
+                                   shim_globalNs() + 500 * MS);
+        shim_run(mespWS2812B_loop, second_ns + 1000 * MS);
+
+        decoder_result_t wire;
+        decoder_decodeStrip(&wire);
+        CHECK(wire.count == 1 && wire.errors == 0, "wake %u: %zu frames, %s", i,
+              wire.count, wire.error);
+        if (wire.count)
+        {
+            // one device, the local time of the strip is the global time
+            const double latency_ms = (wire.frames[0].start_ns
+                    - esp_startNs(frame)) / MS;
+            worst_ms = fmax(worst_ms, latency_ms);
+            sum_ms += latency_ms;
+        }
+        decoder_free(&wire);
+
+        size_t count, j;
+        const shim_spi_byte_t *log = shim_spiLog(&count);
+        for (j = 0; j < count; j++)
+            CHECK(fabs(log[j].bit_ns - 200) <= 2,
+                  "wake %u: bit of %.1fns, the FLL has not locked", i, log[j].bit_ns);
+    }
+    const double one_fps_ma = averageMa(charge_uc, since_ns);
+
+    // the frame has to be received and encoded at 25MHz anyway
+    const double receive_ms = (4 + 3) * esp_config.byte_ns / MS;
+    const double encode_ms = (CYCLE_MODEL_LIMITER + CYCLE_MODEL_ENCODE_BYTE
+            * WS2812B_CHANNEL_COUNT * WS2812B_LED_COUNT) / 25e6 * 1e3;
+    printf("wake to first refresh: %.3fms average, %.3fms worst (receive %.3fms, encode %.3fms)\n",
+           sum_ms / WAKES, worst_ms, receive_ms, encode_ms);
+    printf("average current: %.1fuA idle, %.1fuA at one frame per second\n",
+           idle_ma * 1e3, one_fps_ma * 1e3);
+
+    CHECK(worst_ms - receive_ms - encode_ms < MAX_WAKE_MS,
+          "%.3fms from the start code to the strip", worst_ms);
+    CHECK(idle_ma < MAX_IDLE_MA, "%.1fuA while idle", idle_ma * 1e3);
+    CHECK(one_fps_ma < MAX_ONE_FPS_MA, "%.1fuA at one frame per second",
+          one_fps_ma * 1e3);
+    CHECK(shim_uca0_overruns == 0 && shim_uca0_lost == 0,
+          "%u bytes overran, %u lost", shim_uca0_overruns, shim_uca0_lost);
+    CHECK(shim_vcore_violations == 0, "MCLK too fast for the vcore");
+    CHECK(shim_spi_retimed == 0, "the clock has been lowered %u times while the strip was sent",
+          shim_spi_retimed);
+
+    return test_result("test-lpm");
+}
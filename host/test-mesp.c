@@ -0,0 +1,192 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Frames of the scripted ESP are clocked into USCI_A0 byte by byte, received by the ISR, decoded by the
+ * main loop and checked on the data line of the strip. The lamp sleeps between the frames.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "shim.h"
+#include "esp.h"
+#include "ws2812b-decoder.h"
+#include "mesp-ws2812b.h"
+#include "ws2812b.h"
+#include "frame-queue.h"
+#include "test.h"
+
+#define MS 1e6
+
+// Checks that the last frame on the wire shows 'colors' (r, g, b per led) without timing errors
+static void checkStrip(const uint8_t *colors, const char *what)
+{
+    decoder_result_t wire;
+    decoder_decodeStrip(&wire);
+    CHECK(wire.count > 0, "%s: nothing has been sent", what);
+    if (wire.count == 0)
+        return;
+
+    const decoder_frame_t *frame = &wire.frames[wire.count - 1];
+    CHECK(frame->latched, "%s: the frame has not been latched", what);
+    CHECK(frame->errors == 0, "%s: %s", what, wire.error);
+    CHECK(frame->length == 3 * WS2812B_LED_COUNT, "%s: %zu bytes", what,
+          frame->length);
+
+    uint16_t i;
+    for (i = 0; i < WS2812B_LED_COUNT && 3 * i + 2 < frame->length; i++)
+    {
+        const uint8_t *led = &frame->bytes[3 * i];
+        const uint8_t *color = &colors[3 * i];
+        CHECK(led[0] == color[1] && led[1] == color[0] && led[2] == color[2],
+              "%s: led %u is %02x%02x%02x (GRB), expected %02x%02x%02x (RGB)",
+              what, i, led[0], led[1], led[2], color[0], color[1], color[2]);
+    }
+    decoder_free(&wire);
+}
+
+static void checkLink(const char *what)
+{
+    CHECK(shim_uca0_overruns == 0, "%s: %u bytes overran USCI_A0", what,
+          shim_uca0_overruns);
+    CHECK(shim_uca0_lost == 0, "%s: %u bytes lost", what, shim_uca0_lost);
+    CHECK(shim_vcore_violations == 0, "%s: MCLK too fast for the vcore", what);
+}
+
+// Runs until a frame queued after shim_spiClear has been shown
+static void run(int frame, uint8_t cmd)
+{
+    shim_run(mespWS2812B_loop, shim_now_ns() + 50 * MS);
+    CHECK(!isnan(esp_endNs(frame)), "frame 0x%02x has not been sent", cmd);
+}
+
+// Sends a frame and runs until it has been shown
+static void sendAndRun(uint8_t cmd, const uint8_t *data, uint8_t length)
+{
+    shim_spiClear();
+    run(esp_send(cmd, data, length, shim_globalNs() + 10 * MS), cmd); // the lamp sleeps by then
+}
+
+int main(void)
+{
+    shim_reset();
+    esp_reset();
+    mespWS2812B_init();
+    mespWS2812B_enable();
+    shim_run(mespWS2812B_loop, 500 * MS);
+    const double asleep = shim_sleepNs();
+    shim_run(mespWS2812B_loop, 1000 * MS);
+
+    uint8_t black[3 * WS2812B_LED_COUNT] = { 0 };
+    checkStrip(black, "power-up");
+    CHECK(shim_rdy(), "RDY is low while the lamp waits for frames");
+    CHECK(shim_sleepNs() - asleep > 0.99 * 500 * MS,
+          "the lamp slept %.1fms of 500ms while the strip is static",
+          (shim_sleepNs() - asleep) / MS);
+
+    uint8_t colors[3 * WS2812B_LED_COUNT];
+    uint16_t i;
+    for (i = 0; i < sizeof(colors); i++)
+        colors[i] = (uint8_t) (17 * i + 1);
+    sendAndRun(MESP_WS2812B_CMD_INDIVIDUAL, colors, sizeof(colors));
+    checkStrip(colors, "individual");
+    checkLink("individual");
+
+    const uint8_t single[3] = { 0x12, 0x34, 0x56 };
+    for (i = 0; i < WS2812B_LED_COUNT; i++)
+        memcpy(&colors[3 * i], single, 3);
+    sendAndRun(MESP_WS2812B_CMD_SINGLE, single, sizeof(single));
+    checkStrip(colors, "single");
+    checkLink("single");
+
+    // Frames shorter than the strip leave the other leds alone, received straight into the back buffer...
+    const uint8_t head[2 * 3] = { 0xAA, 0xBB, 0xCC, 0x11, 0x22, 0x33 };
+    memcpy(colors, head, 3);
+    sendAndRun(MESP_WS2812B_CMD_INDIVIDUAL, head, 3);
+    checkStrip(colors, "partial");
+    checkLink("partial");
+
+    // ...and applied from the queue of scheduled frames (tick 0 is due right away)
+    memcpy(colors, head, sizeof(head));
+    shim_spiClear();
+    run(esp_sendScheduled(0, MESP_WS2812B_CMD_INDIVIDUAL, head, sizeof(head),
+                          shim_globalNs() + 10 * MS),
+        MESP_WS2812B_CMD_SCHEDULED);
+    checkStrip(colors, "partial scheduled");
+    checkLink("partial scheduled");
+
+    // A scheduled frame longer than the strip is truncated like the same frame sent directly
+    uint8_t longer[3 * (WS2812B_LED_COUNT + 5)];
+    for (i = 0; i < sizeof(longer); i++)
+        longer[i] = (uint8_t) (29 * i + 7);
+    memcpy(colors, longer, sizeof(colors));
+    shim_spiClear();
+    run(esp_sendScheduled(0, MESP_WS2812B_CMD_INDIVIDUAL, longer, sizeof(longer),
+                          shim_globalNs() + 10 * MS),
+        MESP_WS2812B_CMD_SCHEDULED);
+    checkStrip(colors, "long scheduled");
+    checkLink("long scheduled");
+
+    // More scheduled frames than the queue holds: RDY holds the ESP back until a frame has been applied
+    const double first_ns = shim_globalNs() + 100 * MS;
+    uint8_t scheduled[FRAME_QUEUE_SIZE + 2][3];
+    shim_spiClear();
+    for (i = 0; i < FRAME_QUEUE_SIZE + 2; i++)
+    {
+        scheduled[i][0] = (uint8_t) (0x10 + i);
+        scheduled[i][1] = 0x20;
+        scheduled[i][2] = 0x30;
+        esp_sendScheduled(esp_tick(first_ns + i * 50 * MS), MESP_WS2812B_CMD_SINGLE,
+                          scheduled[i], 3, shim_globalNs() + (10 + 5 * i) * MS); // each one decoded in time
+    }
+    shim_run(mespWS2812B_loop, first_ns + (FRAME_QUEUE_SIZE + 2) * 50 * MS);
+    decoder_result_t wire;
+    decoder_decodeStrip(&wire);
+    CHECK(wire.count == FRAME_QUEUE_SIZE + 2, "queue full: %zu of %u frames shown", wire.count,
+          FRAME_QUEUE_SIZE + 2);
+    for (i = 0; i < wire.count && i < FRAME_QUEUE_SIZE + 2; i++)
+        CHECK(wire.frames[i].bytes[1] == scheduled[i][0],
+              "queue full: frame %u shows 0x%02x, expected 0x%02x", i, wire.frames[i].bytes[1],
+              scheduled[i][0]);
+    decoder_free(&wire);
+    CHECK(esp_isIdle(), "queue full: the ESP has not sent every frame");
+    CHECK(shim_rdy(), "queue full: RDY is low after the queue has been emptied");
+    checkLink("queue full");
+
+    // A SYNC can not be scheduled, the queued frame has no timestamp of its start code
+    esp_sendSync(shim_globalNs() + 10 * MS);
+    const uint8_t bogus[4] = { 0x00, 0x00, 0x00, 0x80 };
+    esp_sendScheduled(0, MESP_WS2812B_CMD_SYNC, bogus, sizeof(bogus), shim_globalNs() + 20 * MS);
+    const double due_ns = shim_globalNs() + 100 * MS;
+    shim_spiClear();
+    run(esp_sendScheduled(esp_tick(due_ns), MESP_WS2812B_CMD_SINGLE, single, sizeof(single),
+                          shim_globalNs() + 30 * MS),
+        MESP_WS2812B_CMD_SCHEDULED);
+    shim_run(mespWS2812B_loop, due_ns + 10 * MS);
+    decoder_decodeStrip(&wire);
+    CHECK(wire.count == 1 && wire.frames[0].start_ns >= due_ns
+                  && wire.frames[0].start_ns < due_ns + 2 * MS,
+          "scheduled sync: %zu frames, the first %.3fms after its tick", wire.count,
+          wire.count ? (wire.frames[0].start_ns - due_ns) / MS : NAN);
+    decoder_free(&wire);
+    checkLink("scheduled sync");
+
+    sendAndRun(MESP_WS2812B_CMD_CLEAR, NULL, 0);
+    checkStrip(black, "clear");
+    checkLink("clear");
+
+    return test_result("test-mesp");
+}
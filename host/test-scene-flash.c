@@ -0,0 +1,300 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * The scene ring in the simulated information memory. A sequence of scenes is committed, wrapping the ring
+ * several times. In every scenario the power is lost during a different flash operation (byte write or
+ * segment erase), the interrupted operation leaves random bits behind. After the reboot the newest complete
+ * scene (or the interrupted one, if it made it) has to be loaded, and the ring has to keep working.
+ *
+ * RDY has to be low while the flash is written and has to come back in the state it has been in before.
+ * A frame the ESP starts around the moment RDY goes low must not be lost. A scene longer than a slot is
+ * truncated, restoring and applying it again must not write the flash again.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "shim.h"
+#include "esp.h"
+#include "mesp.h"
+#include "scene-flash.h"
+#include "ws2812b.h"
+#include "test.h"
+
+#define MS 1e6
+#define SCENE_COUNT 14 // more than the slots in the ring
+#define COMMIT_NS (SCENE_FLASH_COMMIT_DELAY / 32768.0 * 1e9 + 2500 * MS) // the timebase wakes up every 2s
+#define RACE_WINDOW_NS 40000.0 // frames sent from this long before the commit until this long after
+#define RACE_STEP_NS 1000.0
+
+typedef struct
+{
+    long operations;   // flash operations of the whole sequence
+    int interrupted;   // scene that was being committed when the power was lost, 0 if none
+    int loaded;        // scene loaded after the reboot, 0 if none
+    int final;         // scene loaded after the sequence
+    double commit_ns;  // main loop pass that has written the scene
+    bool received;     // the frame of the ESP has been received
+} flash_result_t;
+
+static uint8_t frame_data[SCENE_FLASH_DATA_SIZE];
+static flash_result_t *race;
+
+static void receiveFrame(mesp_data_frame_t *frame)
+{
+    if (race && frame->cmd == 0x02 && frame->length == 3)
+        race->received = true;
+}
+
+static void boot(void)
+{
+    shim_reset();
+    esp_reset();
+    ws2812b_initClockTo25MHz(); // the receiver does not keep up at the power-up clock
+    timebase_init();
+    mesp_init(&receiveFrame);
+    __enable_interrupt();
+}
+
+static void sleepLoop(void)
+{
+    const double pass_ns = shim_now_ns();
+    const uint32_t writes = shim_flash_writes;
+    mesp_loop();
+    sceneFlash_loop();
+    if (race && shim_flash_writes != writes)
+        race->commit_ns = pass_ns;
+    __bis_SR_register(LPM3_bits + GIE); // woken up by the timebase or a frame
+}
+
+static void scene(int number, mesp_data_frame_t *frame)
+{
+    frame->cmd = 0x03;
+    frame->length = SCENE_FLASH_DATA_SIZE;
+    frame->data = frame_data;
+    uint8_t i;
+    for (i = 0; i < SCENE_FLASH_DATA_SIZE; i++)
+        frame_data[i] = (uint8_t) (number * 7 + i);
+}
+
+// Returns the number of the scene in the flash, 0 if there is none or it is corrupted
+static int loadScene(void)
+{
+    uint8_t data[SCENE_FLASH_DATA_SIZE];
+    mesp_data_frame_t frame = { .data = data };
+    if (!sceneFlash_load(&frame))
+        return 0;
+
+    const int number = (uint8_t) (data[0] / 7);
+    mesp_data_frame_t expected;
+    scene(number, &expected);
+    const bool intact = frame.cmd == expected.cmd && frame.length == expected.length
+            && memcmp(data, frame_data, SCENE_FLASH_DATA_SIZE) == 0;
+    CHECK(intact, "a corrupted scene has been loaded");
+    return intact ? number : -1;
+}
+
+// Commits the scenes 'first' to SCENE_COUNT, returns false if the power has been lost
+static bool commitScenes(int first, flash_result_t *result)
+{
+    int number;
+    for (number = first; number <= SCENE_COUNT; number++)
+    {
+        mesp_data_frame_t frame;
+        scene(number, &frame);
+        sceneFlash_store(&frame);
+        result->interrupted = number;
+        const uint32_t writes = shim_flash_writes;
+
+        mesp_enableIncoming();
+        if (setjmp(shim_power_loss))
+            return false;
+        shim_run(sleepLoop, shim_now_ns() + COMMIT_NS);
+        CHECK(shim_flash_writes > writes, "scene %d has not been written", number);
+        CHECK(shim_rdy(), "RDY has not been restored");
+    }
+    result->interrupted = 0;
+    return true;
+}
+
+static void powerLoss(void *result, const void *argument)
+{
+    flash_result_t *flash = result;
+    memset(flash, 0, sizeof(*flash));
+    const long index = *(const long*) argument;
+
+    boot();
+    loadScene();
+    shim_armPowerLoss(index, (uint32_t) index * 2654435761u);
+    if (commitScenes(1, flash))
+    {
+        flash->operations = (long) (shim_flash_writes + shim_flash_erases);
+        flash->final = loadScene();
+        return;
+    }
+
+    // reboot
+    const int interrupted = flash->interrupted;
+    boot();
+    flash->loaded = loadScene();
+    CHECK(flash->loaded == interrupted || flash->loaded == interrupted - 1,
+          "power lost while scene %d was written, scene %d loaded", interrupted,
+          flash->loaded);
+    flash->interrupted = interrupted;
+
+    flash_result_t rest = *flash;
+    CHECK(commitScenes(interrupted + 1, &rest), "power lost twice");
+    flash->final = loadScene();
+    CHECK(flash->final == (interrupted < SCENE_COUNT ? SCENE_COUNT : flash->loaded),
+          "scene %d loaded after the sequence", flash->final);
+    CHECK(shim_flash_violations == 0, "the flash has been written while locked");
+}
+
+// A frame is being received when the scene is due: nothing is written, RDY is restored
+static void receiving(void *result, const void *argument)
+{
+    flash_result_t *flash = result;
+    const bool incoming = *(const bool*) argument;
+    memset(flash, 0, sizeof(*flash));
+
+    boot();
+    loadScene();
+    mesp_data_frame_t frame;
+    scene(1, &frame);
+    sceneFlash_store(&frame);
+    if (incoming)
+        mesp_enableIncoming();
+    else
+        mesp_disableIncoming();
+
+    const uint8_t start[] = { MESP_START_CODE, 0x02, 3, 0x10 }; // the rest of the frame never comes
+    if (incoming)
+        esp_sendRaw(start, sizeof(start), shim_globalNs() + 10 * MS);
+    shim_run(sleepLoop, shim_now_ns() + COMMIT_NS);
+
+    CHECK(shim_rdy() == incoming, "RDY is %s, it was %s before", shim_rdy() ? "high" : "low",
+          incoming ? "high" : "low");
+    if (incoming)
+        CHECK(shim_flash_writes == 0, "the flash has been written while a frame was received");
+    else
+        CHECK(shim_flash_writes > 0, "the scene has not been written");
+}
+
+// A scene longer than a slot is committed, loaded and stored again like mespWS2812B_init replays it
+static void overlong(void *result, const void *argument)
+{
+    flash_result_t *flash = result;
+    (void) argument;
+    memset(flash, 0, sizeof(*flash));
+
+    boot();
+    loadScene();
+    uint8_t data[SCENE_FLASH_DATA_SIZE + 10];
+    memset(data, 0x5A, sizeof(data));
+    mesp_data_frame_t frame = { .cmd = 0x01, .length = sizeof(data), .data = data };
+    sceneFlash_store(&frame);
+    mesp_enableIncoming();
+    shim_run(sleepLoop, shim_now_ns() + COMMIT_NS);
+    CHECK(shim_flash_writes > 0, "the scene has not been written");
+
+    uint8_t restored[SCENE_FLASH_DATA_SIZE];
+    mesp_data_frame_t scene = { .data = restored };
+    CHECK(sceneFlash_load(&scene), "the scene has not been loaded");
+    CHECK(scene.length == SCENE_FLASH_DATA_SIZE, "a length of %u has been loaded", scene.length);
+    sceneFlash_store(&scene);
+    const uint32_t writes = shim_flash_writes, erases = shim_flash_erases;
+    shim_run(sleepLoop, shim_now_ns() + COMMIT_NS);
+    CHECK(shim_flash_writes == writes && shim_flash_erases == erases,
+          "the restored scene has been written again");
+}
+
+// The ESP sends a frame 'offset' from the pass of the main loop that commits the scene
+static void startRace(void *result, const void *argument)
+{
+    race = result;
+    memset(race, 0, sizeof(*race));
+    const double *commit_offset = argument;
+
+    boot();
+    loadScene();
+    mesp_data_frame_t frame;
+    scene(1, &frame);
+    sceneFlash_store(&frame);
+    mesp_enableIncoming();
+
+    const uint8_t color[3] = { 0x12, 0x34, 0x56 };
+    if (!isnan(commit_offset[0]))
+        esp_send(0x02, color, sizeof(color), commit_offset[0] + commit_offset[1]);
+    shim_run(sleepLoop, shim_now_ns() + 2 * COMMIT_NS); // the scene is written once the frame is through
+
+    CHECK(isnan(commit_offset[0]) || race->received, "the frame sent at %+.1fus has been lost",
+          commit_offset[1] / 1000);
+    CHECK(shim_uca0_overruns == 0, "%+.1fus: %u bytes overran", commit_offset[1] / 1000,
+          shim_uca0_overruns);
+}
+
+int main(void)
+{
+    // a sequence without power loss counts the flash operations
+    long index = -1;
+    flash_result_t clean;
+    test_fork(&powerLoss, &index, &clean, sizeof(clean));
+    CHECK(clean.final == SCENE_COUNT, "scene %d loaded after the sequence", clean.final);
+
+    int kept_old = 0, kept_new = 0;
+    for (index = 0; index < clean.operations; index++)
+    {
+        flash_result_t flash;
+        if (!test_fork(&powerLoss, &index, &flash, sizeof(flash)))
+        {
+            fprintf(stderr, "power loss at flash operation %ld\n", index);
+            continue;
+        }
+        if (flash.loaded == flash.interrupted)
+            kept_new++;
+        else
+            kept_old++;
+    }
+    printf("%ld power losses: the interrupted scene survived %d times, the one before %d times\n",
+           clean.operations, kept_new, kept_old);
+
+    const bool rdy[] = { false, true };
+    unsigned i;
+    for (i = 0; i < sizeof(rdy) / sizeof(rdy[0]); i++)
+    {
+        flash_result_t flash;
+        test_fork(&receiving, &rdy[i], &flash, sizeof(flash));
+    }
+
+    flash_result_t flash;
+    test_fork(&overlong, NULL, &flash, sizeof(flash));
+
+    // the pass of the main loop that commits without any frame
+    double commit_offset[2] = { NAN, 0 };
+    flash_result_t probe;
+    test_fork(&startRace, commit_offset, &probe, sizeof(probe));
+    CHECK(probe.commit_ns > 0, "the scene has not been written");
+
+    commit_offset[0] = probe.commit_ns;
+    for (commit_offset[1] = -RACE_WINDOW_NS; commit_offset[1] <= RACE_WINDOW_NS;
+            commit_offset[1] += RACE_STEP_NS)
+    {
+        flash_result_t flash;
+        test_fork(&startRace, commit_offset, &flash, sizeof(flash));
+    }
+
+    return test_result("test-scene-flash");
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Several lamps synchronized by the same ESP. Every lamp boots in its own process at another point of the
+ * global time line with another crystal and REFO error, some of them are busy with the spectrum effect from
+ * right after their power-up until after the sync frame. XT1 takes 300ms to start, the lamps have to switch
+ * ACLK and the timebase from REFO to XT1 whether they idle or not. All of them are synchronized and then get
+ * the same scheduled SINGLE frame, the first frame on each strip showing its color has to start at the same
+ * global time within MAX_SKEW_US.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "shim.h"
+#include "esp.h"
+#include "ws2812b-decoder.h"
+#include "mesp-ws2812b.h"
+#include "ws2812b.h"
+#include "test.h"
+
+#define MS 1e6
+#define MAX_SKEW_US 100.0 // a tick of each lamp plus the drift of the crystals
+
+// Times of the script, global except SPECTRUM_NS which is after the power-up of the lamp
+#define SPECTRUM_NS (20 * MS)   // while XT1 is starting
+#define SYNC_NS (1500 * MS)
+#define STOP_NS (1700 * MS)     // a SINGLE frame ends the spectrum effect
+#define SCHEDULED_NS (1800 * MS)
+#define APPLY_NS (2000 * MS)    // the ESP's tick the scheduled frame is applied at
+#define END_NS (2100 * MS)
+
+typedef struct
+{
+    double boot_offset_ns;
+    double xt1_ppm;
+    double refo_ppm;
+    bool spectrum; // busy with the spectrum effect while the sync frame is received
+} lamp_t;
+
+typedef struct
+{
+    double shown_ns; // global time of the first frame with the scheduled color
+} skew_result_t;
+
+static void lamp(void *result, const void *argument)
+{
+    skew_result_t *skew = result;
+    const lamp_t *config = argument;
+    skew->shown_ns = NAN;
+    shim_config.xt1_startup_ms = 300;
+    shim_config.xt1_ppm = config->xt1_ppm;
+    shim_config.refo_ppm = config->refo_ppm;
+    shim_config.boot_offset_ns = config->boot_offset_ns;
+    shim_reset();
+    esp_reset();
+
+    const uint8_t stop[3] = { 0x01, 0x02, 0x03 };
+    const uint8_t color[3] = { 0x40, 0x20, 0x10 };
+    if (config->spectrum)
+        esp_send(MESP_WS2812B_CMD_SPECTRUM, NULL, 0, config->boot_offset_ns + SPECTRUM_NS);
+    esp_sendSync(SYNC_NS);
+    esp_send(MESP_WS2812B_CMD_SINGLE, stop, sizeof(stop), STOP_NS);
+    esp_sendScheduled(esp_tick(APPLY_NS), MESP_WS2812B_CMD_SINGLE, color,
+                      sizeof(color), SCHEDULED_NS);
+
+    mespWS2812B_init();
+    mespWS2812B_enable();
+    shim_run(mespWS2812B_loop, END_NS - config->boot_offset_ns);
+
+    decoder_result_t wire;
+    decoder_decodeStrip(&wire);
+    CHECK(wire.errors == 0, "%s", wire.error);
+    size_t i;
+    for (i = 0; i < wire.count && isnan(skew->shown_ns); i++)
+        if (wire.frames[i].length >= 3 && wire.frames[i].bytes[0] == color[1]
+                && wire.frames[i].bytes[1] == color[0] && wire.frames[i].bytes[2] == color[2])
+            skew->shown_ns = wire.frames[i].start_ns + config->boot_offset_ns;
+    decoder_free(&wire);
+
+    CHECK(!isnan(skew->shown_ns), "the scheduled frame has not been shown");
+    CHECK(esp_isIdle(), "the ESP has not sent every frame");
+    CHECK(!(UCSCTL7 & XT1LFOFFG), "ACLK still runs from REFO");
+    CHECK(shim_uca0_overruns == 0 && shim_uca0_lost == 0,
+          "%u bytes overran, %u lost", shim_uca0_overruns, shim_uca0_lost);
+}
+
+int main(void)
+{
+    const lamp_t lamps[] = { { 0, 0, 0, false },
+                             { 123.4 * MS, 20, 20000, false },
+                             { 377.7 * MS, -20, -20000, false },
+                             { 51.3 * MS, 0, 0, true },
+                             { 250.9 * MS, 20, 20000, true },
+                             { 499.1 * MS, -20, -20000, true } };
+    const size_t count = sizeof(lamps) / sizeof(lamps[0]);
+    double first_ns = INFINITY, last_ns = -INFINITY;
+    size_t i;
+    for (i = 0; i < count; i++)
+    {
+        skew_result_t skew = { NAN };
+        test_fork(&lamp, &lamps[i], &skew, sizeof(skew));
+        printf("lamp booted at %6.1fms, xt1 %+3.0fppm, refo %+4.1f%%, %s: shown %.1fus after the tick\n",
+               lamps[i].boot_offset_ns / MS, lamps[i].xt1_ppm, lamps[i].refo_ppm * 1e-4,
+               lamps[i].spectrum ? "spectrum" : "idle    ", (skew.shown_ns - APPLY_NS) / 1e3);
+        first_ns = fmin(first_ns, skew.shown_ns);
+        last_ns = fmax(last_ns, skew.shown_ns);
+    }
+
+    const double skew_us = (last_ns - first_ns) / 1e3;
+    printf("skew of %zu lamps: %.1fus\n", count, skew_us);
+    CHECK(skew_us <= MAX_SKEW_US, "the lamps show the frame %.1fus apart", skew_us);
+
+    return test_result("test-skew");
+}
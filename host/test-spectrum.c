@@ -0,0 +1,140 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Synthetic tones at the center of every band are sampled by the ADC12 model and processed by spectrum_process.
+ * The band of the tone has to show the level expected from the tone's power, the other bands have to stay
+ * well below it, and a block has to be processed within its share of the block period.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shim.h"
+#include "esp.h"
+#include "cycle-model.h"
+#include "spectrum.h"
+#include "ws2812b.h"
+#include "test.h"
+
+#define MS 1e6
+#define BIN_HZ ((double) SPECTRUM_SAMPLE_RATE / SPECTRUM_BLOCK_SIZE)
+#define LEVEL_TOLERANCE SPECTRUM_LEVEL_PER_BIT // one bit of power
+#define LEAKAGE_BITS 3                          // other bands at least this far below the tone (or silent)
+#define BLOCK_BUDGET_CYCLES (25e6 / 62.5 / 4)   // a quarter of the block period at 25MHz, the rest is for the strip
+
+static const uint8_t bins[SPECTRUM_BAND_COUNT] = { 2, 3, 5, 8, 12, 19, 30, 48 };
+
+typedef struct
+{
+    double hz;
+    double amplitude;
+    bool square;
+} tone_t;
+
+static uint8_t levels[SPECTRUM_BAND_COUNT];
+static uint32_t blocks_left;
+
+static uint16_t sample(double t_ns, void *context)
+{
+    const tone_t *tone = context;
+    const double phase = sin(2 * M_PI * tone->hz * t_ns * 1e-9);
+    const double value = tone->square ? (phase >= 0 ? 1 : -1) : phase;
+    return (uint16_t) lround(2048 + tone->amplitude * value);
+}
+
+static void processLoop(void)
+{
+    if (spectrum_process(levels) && --blocks_left == 0)
+        shim_stop();
+}
+
+// Returns the band levels of a single block of 'tone', the levels start from 0
+static void measure(tone_t *tone)
+{
+    shim_setAdcSource(&sample, tone);
+    spectrum_start();
+    blocks_left = 2; // the first block may have been started before the tone
+    shim_run(processLoop, shim_now_ns() + 100 * MS);
+    memset(levels, 0, sizeof(levels));
+    blocks_left = 1;
+    shim_run(processLoop, shim_now_ns() + 100 * MS);
+    spectrum_stop();
+    CHECK(blocks_left == 0, "%.1fHz: no block has been processed", tone->hz);
+}
+
+// Level of a tone in the center of a bin: power = (N * amplitude / 2)^2
+static int expectedLevel(double amplitude)
+{
+    const int bits = (int) floor(
+            log2(pow(SPECTRUM_BLOCK_SIZE * amplitude / 2, 2)));
+    const int level = (bits - SPECTRUM_FLOOR_BITS) * SPECTRUM_LEVEL_PER_BIT;
+    return level < 0 ? 0 : level > 255 ? 255 : level;
+}
+
+static void checkTone(uint8_t band, double amplitude)
+{
+    tone_t tone = { bins[band] * BIN_HZ, amplitude, false };
+    measure(&tone);
+
+    const int expected = expectedLevel(amplitude);
+    CHECK(abs(levels[band] - expected) <= LEVEL_TOLERANCE,
+          "%.1fHz amplitude %.0f: level %u, expected %d", tone.hz, amplitude,
+          levels[band], expected);
+    uint8_t other;
+    for (other = 0; other < SPECTRUM_BAND_COUNT; other++)
+        CHECK(other == band || levels[other] == 0
+                      || levels[other] + LEAKAGE_BITS * SPECTRUM_LEVEL_PER_BIT <= levels[band],
+              "%.1fHz amplitude %.0f: band %u at %u, the tone's band at %u",
+              tone.hz, amplitude, other, levels[other], levels[band]);
+}
+
+int main(void)
+{
+    shim_reset();
+    esp_reset(); // nothing to send
+    ws2812b_initClockTo25MHz(); // the sample rate is derived from SMCLK
+    __enable_interrupt();       // DMA_ISR hands the blocks over
+
+    uint8_t band;
+    for (band = 0; band < SPECTRUM_BAND_COUNT; band++)
+    {
+        checkTone(band, 2000); // scaled down by 2^5
+        checkTone(band, 40);   // not scaled
+    }
+
+    // silence
+    tone_t silence = { 0, 0, false };
+    measure(&silence);
+    for (band = 0; band < SPECTRUM_BAND_COUNT; band++)
+        CHECK(levels[band] == 0, "silence: band %u at %u", band, levels[band]);
+
+    // A full-scale square wave in the lowest band comes close to the largest goertzel state, the
+    // fundamental has an amplitude of 4 / pi of the square wave
+    tone_t square = { bins[0] * BIN_HZ, 2047, true };
+    measure(&square);
+    CHECK(abs(levels[0] - expectedLevel(2047 * 4 / M_PI)) <= LEVEL_TOLERANCE,
+          "full-scale square wave: level %u, expected %d", levels[0],
+          expectedLevel(2047 * 4 / M_PI));
+
+    const double block_cycles = shim_cycles[SHIM_SUB_SPECTRUM] / cycleModel_blocks;
+    printf("spectrum_process: %.0f cycles per block (%.1f%% of the block period)\n",
+           block_cycles, 100 * block_cycles / (25e6 / 62.5));
+    CHECK(block_cycles <= BLOCK_BUDGET_CYCLES, "%.0f cycles per block",
+          block_cycles);
+
+    return test_result("test-spectrum");
+}
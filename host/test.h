@@ -0,0 +1,100 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Minimal check macros shared by the host tests. A failed check is reported and the test goes on,
+ * test_result decides the exit code.
+ */
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static int test_failures = 0;
+
+#define CHECK(condition, ...) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            test_failures++; \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+        } \
+    } \
+    while (0)
+
+/**
+ * This function runs 'scenario' in a child process, so the firmware starts from its power-up state
+ * (static variables included) in every scenario. The child hands 'size' bytes of results back.
+ * Failed checks in the child count as one failure.
+ *
+ * @return true if the child has run to its end without failed checks
+ */
+static inline bool test_fork(void (*scenario)(void *result, const void *argument),
+                             const void *argument, void *result, size_t size)
+{
+    int fds[2];
+    if (pipe(fds))
+        return false;
+    fflush(stdout);
+    fflush(stderr);
+
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        test_failures = 0; // count only the checks of this scenario
+        scenario(result, argument);
+        if (write(fds[1], result, size) != (ssize_t) size)
+            _exit(2);
+        _exit(test_failures ? 1 : 0);
+    }
+    close(fds[1]);
+
+    size_t received = 0;
+    ssize_t n;
+    while (received < size
+            && (n = read(fds[0], (char*) result + received, size - received)) > 0)
+        received += (size_t) n;
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    const bool passed = received == size && WIFEXITED(status)
+            && WEXITSTATUS(status) == 0;
+    if (!passed)
+        test_failures++;
+    return passed;
+}
+
+static inline int test_result(const char *name)
+{
+    if (test_failures)
+    {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif /* HOST_TEST_H_ */
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ws2812b-decoder.h"
+
+typedef struct
+{
+    decoder_result_t *result;
+    decoder_frame_t *frame; // NULL between frames
+    size_t bits;
+    bool level;
+    double rise, fall;      // last edges
+    bool pulse;             // a high pulse waits for its low phase
+} decoder_state_t;
+
+static void error(decoder_state_t *state, const char *what, double ns)
+{
+    state->frame->errors++;
+    if (state->result->errors++ == 0)
+        snprintf(state->result->error, sizeof(state->result->error),
+                 "frame %zu byte %zu bit %zu at %.3fms: %s %.0fns",
+                 state->result->count - 1, state->bits / 8, state->bits % 8,
+                 state->rise / 1e6, what, ns);
+}
+
+static void beginFrame(decoder_state_t *state)
+{
+    decoder_result_t *result = state->result;
+    result->frames = realloc(result->frames,
+                             (result->count + 1) * sizeof(*result->frames));
+    state->frame = &result->frames[result->count++];
+    memset(state->frame, 0, sizeof(*state->frame));
+    state->frame->start_ns = state->rise;
+    state->bits = 0;
+}
+
+static void endFrame(decoder_state_t *state, bool latched)
+{
+    if (state->bits % 8)
+        error(state, "incomplete byte, bits", (double) (state->bits % 8));
+    state->frame->length = state->bits / 8;
+    state->frame->end_ns = state->fall;
+    state->frame->latched = latched;
+    state->frame = NULL;
+}
+
+// A complete bit, 'low' is < 0 if the line has not gone high again yet
+static void bit(decoder_state_t *state, double high, double low)
+{
+    bool one = high > (DECODER_T0H_NS + DECODER_T1H_NS) / 2;
+    if (fabs(high - DECODER_T0H_NS) > DECODER_TOLERANCE_NS
+            && fabs(high - DECODER_T1H_NS) > DECODER_TOLERANCE_NS)
+        error(state, "high", high);
+
+    if (low >= 0 && low < DECODER_RESET_NS)
+    {
+        const double expected = one ? DECODER_T1L_NS : DECODER_T0L_NS;
+        if (fabs(low - expected) > DECODER_TOLERANCE_NS)
+            error(state, one ? "T1L" : "T0L", low);
+    }
+
+    if (state->bits / 8 < DECODER_FRAME_MAX)
+    {
+        uint8_t *byte = &state->frame->bytes[state->bits / 8];
+        *byte = (uint8_t) ((*byte << 1) | one);
+    }
+    state->bits++;
+}
+
+static void edge(decoder_state_t *state, bool level, double t)
+{
+    if (level == state->level)
+        return;
+    state->level = level;
+
+    if (level)
+    {
+        if (state->pulse)
+        {
+            const double low = t - state->fall;
+            bit(state, state->fall - state->rise, low);
+            if (low >= DECODER_RESET_NS)
+                endFrame(state, true);
+        }
+        state->rise = t;
+        state->pulse = false;
+        if (!state->frame)
+            beginFrame(state);
+    }
+    else
+    {
+        state->fall = t;
+        state->pulse = true;
+    }
+}
+
+void decoder_decode(decoder_result_t *result, const shim_spi_byte_t *log,
+                    size_t count, double now_ns)
+{
+    memset(result, 0, sizeof(*result));
+    decoder_state_t state = { .result = result };
+
+    size_t i;
+    for (i = 0; i < count; i++)
+    {
+        // the line keeps the level of the last bit between two bytes
+        int b;
+        for (b = 7; b >= 0; b--)
+            edge(&state, (log[i].value >> b) & 1,
+                 log[i].start_ns + (7 - b) * log[i].bit_ns);
+    }
+    if (count)
+        edge(&state, false, log[count - 1].start_ns + 8 * log[count - 1].bit_ns);
+
+    if (state.pulse)
+    {
+        const double low = now_ns - state.fall;
+        bit(&state, state.fall - state.rise, low >= DECODER_RESET_NS ? low : -1);
+        endFrame(&state, low >= DECODER_RESET_NS);
+    }
+}
+
+void decoder_decodeStrip(decoder_result_t *result)
+{
+    size_t count;
+    const shim_spi_byte_t *log = shim_spiLog(&count);
+    decoder_decode(result, log, count, shim_now_ns());
+}
+
+void decoder_free(decoder_result_t *result)
+{
+    free(result->frames);
+    memset(result, 0, sizeof(*result));
+}
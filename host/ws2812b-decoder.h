@@ -0,0 +1,77 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+/*
+ * Decoder for the data line of WS2812B/SK6812 strips. The SPI output logged by the shim is turned into
+ * the pulses a led sees and every pulse is checked against the timing of the datasheet:
+ * T0H 400ns, T1H 800ns, T0L 850ns, T1L 450ns, each +-150ns, and a reset/latch after 50us low.
+ * A low phase longer than a bit but shorter than a reset is a timing error, some leds latch early on it.
+ */
+
+#ifndef HOST_WS2812B_DECODER_H_
+#define HOST_WS2812B_DECODER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "shim.h"
+
+#define DECODER_T0H_NS 400
+#define DECODER_T1H_NS 800
+#define DECODER_T0L_NS 850
+#define DECODER_T1L_NS 450
+#define DECODER_TOLERANCE_NS 150
+#define DECODER_RESET_NS 50000
+
+#define DECODER_FRAME_MAX 1024 // bytes of a frame that are kept
+
+// One frame between two resets, the bytes in the order they have been sent (e.g. G, R, B)
+typedef struct
+{
+    uint8_t bytes[DECODER_FRAME_MAX];
+    size_t length;
+    double start_ns; // first rising edge
+    double end_ns;   // last falling edge
+    unsigned errors; // pulses outside the timing windows
+    bool latched;    // followed by a reset
+} decoder_frame_t;
+
+typedef struct
+{
+    decoder_frame_t *frames;
+    size_t count;
+    unsigned errors;   // of all frames
+    char error[160];   // the first error
+} decoder_result_t;
+
+/**
+ * This function decodes the SPI output logged by the shim.
+ *
+ * @param result The decoded frames, free them with decoder_free
+ * @param log The logged bytes
+ * @param count The number of logged bytes
+ * @param now_ns The time the line has been low since the last byte, decides whether the last frame latched
+ */
+extern void decoder_decode(decoder_result_t *result, const shim_spi_byte_t *log,
+                           size_t count, double now_ns);
+
+/**
+ * This function decodes the SPI output logged by the shim up to the current time.
+ */
+extern void decoder_decodeStrip(decoder_result_t *result);
+
+extern void decoder_free(decoder_result_t *result);
+
+#endif /* HOST_WS2812B_DECODER_H_ */
@@ -19,8 +19,22 @@
 #include "mesp-ws2812b.h"
 #include "ws2812b.h"
 #include "mesp.h"
+#include "spectrum.h"
+#include "scene-flash.h"
+#include "timebase.h"
+#include "frame-queue.h"
+
+// Size of the back buffer of the strip, limited by the maximum data length of a frame
+#if WS2812B_LED_COUNT * WS2812B_CHANNEL_COUNT > 0xFF
+#define MESP_WS2812B_DIRECT_SIZE 0xFF
+#else
+#define MESP_WS2812B_DIRECT_SIZE (WS2812B_LED_COUNT * WS2812B_CHANNEL_COUNT)
+#endif
 
 static void mespWS2812B_decodeFrame(mesp_data_frame_t *frame);
+static void mespWS2812B_applyQueue(void);
+static void mespWS2812B_idle(void);
+static inline uint32_t mespWS2812B_readTick(const uint8_t *data);
 
 static void mespWS2812B_effectNone(void);
 static void mespWS2812B_effectRainbow(void);
@@ -31,38 +45,70 @@ static void mespWS2812B_effectFire(void);
 static void mespWS2812B_effectStartlight(void);
 static void mespWS2812B_effectSpectrum(void);
 
+static void mespWS2812B_setEffect(void_void_fct_t fct);
+static inline void mespWS2812B_armDirectBuffer(void);
+
 static void_void_fct_t effect_fct;
 
+static uint8_t spectrum_levels[SPECTRUM_BAND_COUNT];
+
+static bool enabled = false; // set by mespWS2812B_enable, nothing can wake the CPU up otherwise
+
+static uint32_t clock_offset = 0; // difference between the ESP tick and the local tick
+
+/**
+ * Data of frames that do not come from the receiver, e.g. restored or queued frames.
+ * The back buffer of the strip can not be used for them as the receiver may be writing into it.
+ */
+static uint8_t frame_data[MESP_WS2812B_DIRECT_SIZE];
+
 void mespWS2812B_init(void)
 {
-    ws2812b_init();
+    ws2812b_startClockTo25MHz(); // the clock settles while the peripherals are set up
+    timebase_init();
+    ws2812b_initSPI();
     mesp_init(&mespWS2812B_decodeFrame);
+    mespWS2812B_armDirectBuffer();
     effect_fct = &mespWS2812B_effectNone;
+    mespWS2812B_enable(); // frames are received by the ISR but not decoded before mespWS2812B_loop
+
+    ws2812b_clearStrip();
+    ws2812b_waitForClock(); // the strip timing needs the final clock
+    ws2812b_showStrip();
+
+    // Restore the scene from before the power-up
+    mesp_data_frame_t scene = { .data = frame_data };
+    if (sceneFlash_load(&scene))
+        mespWS2812B_decodeFrame(&scene);
 }
 
 inline void mespWS2812B_loop(void)
 {
     mesp_loop();
+    ws2812b_checkXT1(); // XT1 starts long after the power-up, the timebase runs from REFO until then
+    mespWS2812B_applyQueue();
     effect_fct();
+    sceneFlash_loop();
+    mespWS2812B_idle();
 }
 
 void mespWS2812B_clear(void)
 {
-    effect_fct = &mespWS2812B_effectNone;
+    mespWS2812B_setEffect(&mespWS2812B_effectNone);
     ws2812b_clearStrip();
     ws2812b_showStrip();
 }
 
 void mespWS2812B_single(mespWS2812B_color_t *color)
 {
-    effect_fct = &mespWS2812B_effectNone;
+    mespWS2812B_setEffect(&mespWS2812B_effectNone);
     ws2812b_fillStrip(color->r, color->g, color->b);
     ws2812b_showStrip();
 }
 
 void mespWS2812B_individual(mespWS2812B_color_t *colors, uint8_t length)
 {
-    effect_fct = &mespWS2812B_effectNone;
+    mespWS2812B_setEffect(&mespWS2812B_effectNone);
     ws2812b_clearStrip();
     uint8_t i;
     for (i = 0; i < length; i++)
@@ -84,14 +130,29 @@ void mespWS2812B_random(uint8_t length)
     ws2812b_showStrip();
 }
 
+void mespWS2812B_spectrum(void)
+{
+    if (effect_fct == &mespWS2812B_effectSpectrum)
+        return; // already sampling
+
+    uint8_t i;
+    for (i = 0; i < SPECTRUM_BAND_COUNT; i++)
+        spectrum_levels[i] = 0;
+    mespWS2812B_setEffect(&mespWS2812B_effectSpectrum);
+    ws2812b_restoreClock(); // the sample rate is derived from SMCLK
+    spectrum_start();
+}
+
 inline void mespWS2812B_enable(void)
 {
+    enabled = true;
     mesp_enableIncoming();
     __bis_SR_register(GIE);
 }
 
 inline void mespWS2812B_disable(void)
 {
+    enabled = false;
     mesp_disableIncoming();
     __bic_SR_register(GIE);
 }
@@ -102,77 +163,156 @@ static void mespWS2812B_decodeFrame(mesp_data_frame_t *frame)
     {
     case MESP_WS2812B_CMD_CLEAR:
         if (frame->length != 0)
-            break;
+            return; // invalid frame
         ws2812b_clearStrip();
         ws2812b_showStrip();
-        effect_fct = &mespWS2812B_effectNone;
+        mespWS2812B_setEffect(&mespWS2812B_effectNone);
         break;
 
     case MESP_WS2812B_CMD_SINGLE:
-        if (frame->length == 3)
-        {
-            const uint8_t r = frame->data[0];
-            const uint8_t g = frame->data[1];
-            const uint8_t b = frame->data[2];
-            ws2812b_fillStrip(r, g, b);
-            ws2812b_showStrip();
-            effect_fct = &mespWS2812B_effectNone;
-        }
+        if (frame->length != 3)
+            return; // invalid frame
+        const uint8_t r = frame->data[0];
+        const uint8_t g = frame->data[1];
+        const uint8_t b = frame->data[2];
+        ws2812b_fillStrip(r, g, b);
+        ws2812b_showStrip();
+        mespWS2812B_setEffect(&mespWS2812B_effectNone);
         break;
 
     case MESP_WS2812B_CMD_INDIVIDUAL:
         if (frame->length == 0)
-            break;
-        uint8_t i;
-        for (i = 0; i < frame->length / 3; i++)
+            return; // invalid frame
+        if (frame->data == ws2812b_getBackBuffer())
+        {
+            // The colors have been received straight into the back buffer of the strip
+            ws2812b_swapBuffers(frame->length / WS2812B_CHANNEL_COUNT);
+            mespWS2812B_armDirectBuffer(); // receive the next frame into the new back buffer
+        }
+        else
         {
-            const uint8_t r = frame->data[(uint8_t) (3 * i + 0)];
-            const uint8_t g = frame->data[(uint8_t) (3 * i + 1)];
-            const uint8_t b = frame->data[(uint8_t) (3 * i + 2)];
-            ws2812b_setLEDColor(i, r, g, b);
+            uint8_t i;
+            for (i = 0; i < frame->length / WS2812B_CHANNEL_COUNT; i++)
+            {
+                const uint8_t *color = &frame->data[(uint8_t) (WS2812B_CHANNEL_COUNT * i)];
+                ws2812b_setLEDColor(i, color[0], color[1], color[2]);
+#if WS2812B_CHANNEL_COUNT == 4
+                ws2812b_setLEDWhite(i, color[3]);
+#endif
+            }
         }
         ws2812b_showStrip();
-        effect_fct = &mespWS2812B_effectNone; // set the new effect function
+        mespWS2812B_setEffect(&mespWS2812B_effectNone); // set the new effect function
         break;
 
     case MESP_WS2812B_CMD_RAINBOW:
         // TODO: decode effect data
         // TODO: set initial conditions
-        effect_fct = &mespWS2812B_effectRainbow; // set the new effect function
+        mespWS2812B_setEffect(&mespWS2812B_effectRainbow); // set the new effect function
         break;
     case MESP_WS2812B_CMD_PULSE:
         // TODO: decode effect data
         // TODO: set initial conditions
-        effect_fct = &mespWS2812B_effectPulse; // set the new effect function
+        mespWS2812B_setEffect(&mespWS2812B_effectPulse); // set the new effect function
         break;
     case MESP_WS2812B_CMD_RANDOM:
         // TODO: decode effect data
         // TODO: set initial conditions
-        effect_fct = &mespWS2812B_effectRandom; // set the new effect function
+        mespWS2812B_setEffect(&mespWS2812B_effectRandom); // set the new effect function
         break;
     case MESP_WS2812B_CMD_GRADIENT:
         // TODO: decode effect data
         // TODO: set initial conditions
-        effect_fct = &mespWS2812B_effectGradient; // set the new effect function
+        mespWS2812B_setEffect(&mespWS2812B_effectGradient); // set the new effect function
         break;
     case MESP_WS2812B_CMD_FIRE:
         // TODO: decode effect data
         // TODO: set initial conditions
-        effect_fct = &mespWS2812B_effectFire;  // set the new effect function
+        mespWS2812B_setEffect(&mespWS2812B_effectFire);  // set the new effect function
         break;
     case MESP_WS2812B_CMD_STARLIGHT:
         // TODO: decode effect data
         // TODO: set initial conditions
-        effect_fct = &mespWS2812B_effectStartlight; // set the new effect function
+        mespWS2812B_setEffect(&mespWS2812B_effectStartlight); // set the new effect function
         break;
     case MESP_WS2812B_CMD_SPECTRUM:
-        // TODO: decode effect data
-        // TODO: set initial conditions
-        effect_fct = &mespWS2812B_effectSpectrum; // set the new effect function
+        mespWS2812B_spectrum(); // starts sampling and sets the new effect function
         break;
+    case MESP_WS2812B_CMD_SYNC:
+        if (frame->length != 4)
+            return; // invalid frame
+        clock_offset = mespWS2812B_readTick(frame->data) - frame->timestamp; // the ESP takes its tick at the start code
+        return; // not a scene
+
+    case MESP_WS2812B_CMD_SCHEDULED:
+        if (frame->length < 5 || frame->data[4] == MESP_WS2812B_CMD_SYNC
+                || frame->data[4] == MESP_WS2812B_CMD_SCHEDULED)
+            return; // invalid frame, a queued frame has no timestamp and can not be queued again
+        const mesp_data_frame_t scheduled = { .cmd = frame->data[4],
+                                              .length = frame->length - 5,
+                                              .data = frame->data + 5 };
+        if (!frameQueue_push(mespWS2812B_readTick(frame->data), &scheduled))
+            return; // dropped, the ESP has started the frame right before RDY went low
+        if (frameQueue_isFull())
+            mesp_disableIncoming(); // the ESP holds the next frame back until a queued frame has been applied
+        return; // applied by mespWS2812B_applyQueue when its tick is reached
+
     default:
-        break;
+        return; // unknown command
+    }
+
+    sceneFlash_store(frame); // remember the scene for the next power-up
+}
+
+static void mespWS2812B_applyQueue(void)
+{
+    mesp_data_frame_t frame = { .data = frame_data };
+    bool applied = false;
+    while (frameQueue_pop(timebase_now() + clock_offset, &frame))
+    {
+        mespWS2812B_decodeFrame(&frame);
+        applied = true;
     }
+    if (applied && enabled)
+        mesp_enableIncoming(); // lowered while the queue was full
+}
+
+static void mespWS2812B_idle(void)
+{
+    if (!enabled || effect_fct != &mespWS2812B_effectNone
+            || !frameQueue_isEmpty() || mesp_isReceiving())
+        return; // the strip is not static or there is something to do
+
+    ws2812b_lowerClock(); // restored before the next refresh of the strip
+    mesp_enableIncoming(); // the start code of the next frame wakes the CPU up
+
+    __disable_interrupt();
+    if (!mesp_isReceiving())
+        __bis_SR_register(LPM3_bits + GIE); // sleep until the ESP sends a frame or the timebase wakes us up
+    else
+        __enable_interrupt(); // a frame has started in the meantime
+
+    if (mesp_isReceiving())
+        ws2812b_restoreClock(); // the clock settles while the rest of the frame is received
+}
+
+static inline uint32_t mespWS2812B_readTick(const uint8_t *data)
+{
+    return (uint32_t) data[0] | ((uint32_t) data[1] << 8)
+            | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+static void mespWS2812B_setEffect(void_void_fct_t fct)
+{
+    if (effect_fct == &mespWS2812B_effectSpectrum && fct != effect_fct)
+        spectrum_stop(); // no need to keep sampling the microphone
+    effect_fct = fct;
+}
+
+static inline void mespWS2812B_armDirectBuffer(void)
+{
+    mesp_setDirectBuffer(MESP_WS2812B_CMD_INDIVIDUAL, ws2812b_getBackBuffer(),
+                         MESP_WS2812B_DIRECT_SIZE);
 }
 
 static void mespWS2812B_effectNone(void)
@@ -199,4 +339,24 @@ static void mespWS2812B_effectStartlight(void)
 }
 static void mespWS2812B_effectSpectrum(void)
 {
+    if (!spectrum_process(spectrum_levels))
+        return; // no new sample block yet
+
+    // Map the bands onto the strip, low bands red, high bands blue
+    uint16_t i;
+    for (i = 0; i < WS2812B_LED_COUNT; i++)
+    {
+        const uint8_t band = (uint8_t) ((uint32_t) i * SPECTRUM_BAND_COUNT
+                / WS2812B_LED_COUNT);
+        const uint8_t hue = (uint8_t) ((uint16_t) band * 255
+                / (SPECTRUM_BAND_COUNT - 1));
+        const uint16_t level = spectrum_levels[band];
+
+        const uint8_t r = (uint8_t) (((255 - hue) * level) >> 8);
+        const uint8_t g = (uint8_t) ((
+                (hue < 128 ? 2 * hue : 2 * (255 - hue)) * level) >> 8);
+        const uint8_t b = (uint8_t) ((hue * level) >> 8);
+        ws2812b_setLEDColor(i, r, g, b);
+    }
+    ws2812b_showStrip();
 }
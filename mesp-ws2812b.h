@@ -59,5 +59,7 @@ extern void mespWS2812B_spectrum(void);
 #define MESP_WS2812B_CMD_FIRE 0x08
 #define MESP_WS2812B_CMD_STARLIGHT 0x09
 #define MESP_WS2812B_CMD_SPECTRUM 0x0A
+#define MESP_WS2812B_CMD_SYNC 0x0B      // data: 4-byte tick of the ESP at the start code (little-endian, 32768 ticks per second)
+#define MESP_WS2812B_CMD_SCHEDULED 0x0C // data: 4-byte tick to apply the frame at, command (not SYNC or SCHEDULED), data of the command
 
 #endif /* MESP_WS2812B_H_ */
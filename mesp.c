@@ -14,6 +14,7 @@
  *limitations under the License.
  */
 #include "mesp.h"
+#include "timebase.h"
 
 static mesp_data_frame_t frame;
 
@@ -21,8 +22,22 @@ static uint8_t data[0xFF];
 
 static mesp_callback_fct_t callback_fct;
 
+static uint8_t direct_cmd = 0;
+static uint8_t *direct_buffer = 0;
+static uint8_t direct_size = 0;
+static uint8_t buffer_size = sizeof(data); // size of the buffer frame.data currently points to
+
+/**
+ * This function runs the receive state machine for one byte received from the ESP.
+ *
+ * @param byte The received byte
+ *
+ * @return true if the main loop has to wake up, i.e. a frame has started or has been finished
+ */
+static inline bool mesp_receiveByte(uint8_t byte);
+
 static uint8_t receive_index = 0;
-static uint8_t mesp_status = 0;
+static volatile uint8_t mesp_status = 0;
 
 void mesp_loop(void)
 {
@@ -42,10 +57,19 @@ void mesp_init(mesp_callback_fct_t callback)
     mesp_status = MESP_STATUS_START;
 }
 
+void mesp_setDirectBuffer(uint8_t cmd, uint8_t *buffer, uint8_t size)
+{
+    direct_cmd = cmd;
+    direct_buffer = buffer;
+    direct_size = size;
+}
+
 void mesp_initSPI(void)
 {
     P3SEL |= BIT3 + BIT4; // MISO, MOSI
     P2SEL |= BIT7;  // CLK
+    P1OUT &= ~BIT6; // RDY low until mesp_enableIncoming is called
+    P1DIR |= BIT6;  // RDY
     UCA0CTL1 |= UCSWRST;
     UCA0CTL0 &= ~(UCMST + UCCKPH + UCCKPL); // ensure slave mode is active, clock inactive when low
     UCA0CTL0 |= UCSYNC + UCMSB; // 3-pin, 8-bit, MSB-first
@@ -53,6 +77,11 @@ void mesp_initSPI(void)
     UCA0IE |= UCRXIE;
 }
 
+bool mesp_isReceiving(void)
+{
+    return mesp_status != MESP_STATUS_START;
+}
+
 inline void mesp_disableIncoming(void)
 {
     P1OUT &= ~BIT6; // ESP will not send data with RDY pin low, set it to low to disable communication
@@ -63,6 +92,71 @@ inline void mesp_enableIncoming(void)
     P1OUT |= BIT6; // ESP will not send data with RDY pin low, set i to high to enable communimaion
 }
 
+bool mesp_isIncomingEnabled(void)
+{
+    return (P1OUT & BIT6) != 0; // RDY
+}
+
+static inline bool mesp_receiveByte(uint8_t byte)
+{
+    // check if all the data has been received
+    if (mesp_status == MESP_STATUS_DATA && receive_index >= frame.length)
+        mesp_status = MESP_STATUS_END; // Change the status to receive end code
+
+    switch (mesp_status)
+    {
+    case MESP_STATUS_START:
+        // Has the start code been sent?
+        if (byte == MESP_START_CODE)
+        {
+            frame.timestamp = timebase_now(); // not delayed by the main loop, e.g. while the strip is refreshed
+            mesp_status = MESP_STATUS_CMD; // Change the status to receive command
+            return true;
+        }
+        break;
+
+    case MESP_STATUS_CMD:
+        frame.cmd = byte;       // save the command
+        if (direct_buffer && frame.cmd == direct_cmd)
+        {
+            frame.data = direct_buffer; // receive straight into the buffer of the user
+            buffer_size = direct_size;
+        }
+        else
+        {
+            frame.data = data;
+            buffer_size = sizeof(data);
+        }
+        mesp_status = MESP_STATUS_LENGTH; // Change the status to receive data length
+        break;
+
+    case MESP_STATUS_LENGTH:
+        frame.length = byte;  // save the data length
+        receive_index = 0;                 // initialize the receive index
+        mesp_status = MESP_STATUS_DATA; // Change the status to receive data
+        break;
+
+    case MESP_STATUS_DATA:
+        if (receive_index < buffer_size) // protection against memory overflow, drop the byte otherwise
+            frame.data[receive_index] = byte; // save the received data to the current index
+        receive_index++;
+        // status changed before switch statement
+        break;
+
+    case MESP_STATUS_END:
+        // Has the end code been sent?
+        if (byte == MESP_END_CODE)
+        {
+            mesp_status = MESP_STATUS_FINISHED; // Change the status to finished
+            return true;
+        }
+        break;
+    default:
+        break;
+    }
+    return false;
+}
+
 #pragma vector = USCI_A0_VECTOR
 __interrupt void USCI_A0_ISR(void)
 {
@@ -71,46 +165,8 @@ __interrupt void USCI_A0_ISR(void)
     case 0: // Vector 0 - no interrupt
         break;
     case 2: // Vector 2 - RXIFG
-        // check if all the data has been received
-        if (mesp_status == MESP_STATUS_DATA && receive_index >= frame.length)
-            mesp_status = MESP_STATUS_END; // Change the status to receive end code
-
-        switch (mesp_status)
-        {
-        case MESP_STATUS_START:
-            // Has the start code been sent?
-            if (UCA0RXBUF == MESP_START_CODE)
-                mesp_status = MESP_STATUS_CMD; // Change the status to receive command
-            break;
-
-        case MESP_STATUS_CMD:
-            frame.cmd = UCA0RXBUF;       // save the command
-            mesp_status = MESP_STATUS_LENGTH; // Change the status to receive data length
-            break;
-
-        case MESP_STATUS_LENGTH:
-            frame.length = UCA0RXBUF;  // save the data length
-            receive_index = 0;                 // initialize the receive index
-            mesp_status = MESP_STATUS_DATA; // Change the status to receive data
-            break;
-
-        case MESP_STATUS_DATA:
-            frame.data[receive_index] = UCA0RXBUF; // save the received data to the current index
-            receive_index++;
-            // status changed before switch statement
-            break;
-
-        case MESP_STATUS_END:
-            // Has the end code been sent?
-            if (UCA0RXBUF == MESP_END_CODE)
-            {
-                mesp_status = MESP_STATUS_FINISHED; // Change the status to finished
-
-            }
-            break;
-        default:
-            break;
-        }
+        if (mesp_receiveByte(UCA0RXBUF)) // read the buffer only once
+            __bic_SR_register_on_exit(LPM3_bits); // wake up the main loop
         break;
     case 4: // Vector 4  - TXIFG
         break;
@@ -19,6 +19,7 @@
 
 #include <msp430.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #define MESP_START_CODE 0xAA
 #define MESP_END_CODE 0x33
@@ -35,6 +36,7 @@ typedef struct
     uint8_t cmd;
     uint8_t length;
     uint8_t *data;
+    uint32_t timestamp; // tick of the timebase when the start code has been received
 } mesp_data_frame_t;
 
 typedef void (*mesp_callback_fct_t)(mesp_data_frame_t*);
@@ -43,6 +45,35 @@ extern void mesp_init(mesp_callback_fct_t callback);
 extern void mesp_initSPI(void);
 extern void mesp_loop(void);
 
+/**
+ * This function makes the receiver write the data of frames with the command 'cmd' directly into 'buffer'
+ * instead of the internal receive buffer. Data exceeding 'size' bytes is dropped.
+ * The buffer must not be changed until the frame has been handed to the callback function.
+ * The callback function may call this function again to exchange the buffer.
+ *
+ * @param cmd The command whose data should be received into 'buffer'
+ * @param buffer The buffer to receive into, NULL to disable direct receiving
+ * @param size The size of 'buffer'
+ */
+extern void mesp_setDirectBuffer(uint8_t cmd, uint8_t *buffer, uint8_t size);
+
+/**
+ * This function checks whether a frame is being received or waits to be handed to the callback function.
+ *
+ * @return true if the receiver is not waiting for a start code
+ */
+extern bool mesp_isReceiving(void);
+
+// The ESP samples RDY right before the start code, a frame can still start this long after RDY has gone low
+#define MESP_RDY_GUARD_CYCLES 500 // 20us at 25MHz
+
 extern inline void mesp_disableIncoming(void);
 extern inline void mesp_enableIncoming(void);
+
+/**
+ * This function checks whether the ESP may send frames, i.e. whether RDY is high.
+ *
+ * @return true if mesp_enableIncoming has been called after mesp_disableIncoming
+ */
+extern bool mesp_isIncomingEnabled(void);
 #endif /* MESP_H_ */
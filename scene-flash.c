@@ -0,0 +1,248 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+#include <msp430.h>
+#include <stddef.h>
+#include <string.h>
+#include "scene-flash.h"
+
+#define SCENE_FLASH_VALID 0xA5 // marks a completely written record
+
+/*
+ * A stored scene. The valid byte is written last, a record that has been interrupted
+ * by a power loss is ignored because of the missing valid byte or the wrong checksum.
+ */
+typedef struct
+{
+    uint16_t sequence;
+    uint8_t cmd;
+    uint8_t length;
+    uint8_t data[SCENE_FLASH_DATA_SIZE];
+    uint8_t checksum;
+    uint8_t valid;
+} sceneFlash_record_t;
+
+#define SCENE_FLASH_SLOTS_PER_SEGMENT (SCENE_FLASH_SEGMENT_SIZE / sizeof(sceneFlash_record_t))
+#define SCENE_FLASH_SLOT_COUNT (SCENE_FLASH_SLOTS_PER_SEGMENT * SCENE_FLASH_SEGMENT_COUNT)
+
+static sceneFlash_record_t pending; // the scene waiting to be written
+static bool pending_valid = false;
+static uint32_t pending_since;
+
+static int16_t latest_slot = -1; // slot of the newest record, -1 if there is none
+static uint16_t sequence = 0;   // sequence number of the newest record
+
+// static functions not to be exposed to the user:
+
+/**
+ * This function returns the record stored in a slot.
+ *
+ * @param slot The index of the slot
+ *
+ * @return The record in the flash
+ */
+static inline const sceneFlash_record_t* sceneFlash_record(uint16_t slot);
+
+/**
+ * This function computes the checksum of a record.
+ *
+ * @param record The record
+ *
+ * @return The checksum
+ */
+static uint8_t sceneFlash_checksum(const sceneFlash_record_t *record);
+
+/**
+ * This function checks whether a slot is erased.
+ *
+ * @param slot The index of the slot
+ *
+ * @return true if all bytes of the slot are erased
+ */
+static bool sceneFlash_isBlank(uint16_t slot);
+
+/**
+ * This function writes the pending scene into the next free slot.
+ * The segment following the newest record is erased when it is reached.
+ */
+static void sceneFlash_commit(void);
+
+/**
+ * This function erases a flash segment.
+ *
+ * @param segment The start address of the segment
+ */
+static void sceneFlash_eraseSegment(uint8_t *segment);
+
+/**
+ * This function writes bytes into erased flash.
+ *
+ * @param destination The flash address to write to
+ * @param source The bytes to write
+ * @param length The number of bytes to write
+ */
+static void sceneFlash_write(uint8_t *destination, const uint8_t *source,
+                             uint8_t length);
+
+bool sceneFlash_load(mesp_data_frame_t *frame)
+{
+    latest_slot = -1;
+
+    uint16_t slot;
+    for (slot = 0; slot < SCENE_FLASH_SLOT_COUNT; slot++)
+    {
+        const sceneFlash_record_t *record = sceneFlash_record(slot);
+        if (record->valid != SCENE_FLASH_VALID
+                || record->checksum != sceneFlash_checksum(record))
+            continue;
+
+        if (latest_slot < 0 || (int16_t) (record->sequence - sequence) > 0)
+        {
+            latest_slot = slot;
+            sequence = record->sequence;
+        }
+    }
+
+    if (latest_slot < 0)
+        return false;
+
+    const sceneFlash_record_t *record = sceneFlash_record(latest_slot);
+    frame->cmd = record->cmd;
+    frame->length = record->length > SCENE_FLASH_DATA_SIZE ?
+            SCENE_FLASH_DATA_SIZE : record->length; // older records hold the length before truncation
+    memcpy(frame->data, record->data, SCENE_FLASH_DATA_SIZE);
+    return true;
+}
+
+void sceneFlash_store(const mesp_data_frame_t *frame)
+{
+    const uint8_t length =
+            frame->length > SCENE_FLASH_DATA_SIZE ?
+                    SCENE_FLASH_DATA_SIZE : frame->length;
+
+    pending.cmd = frame->cmd;
+    pending.length = length; // the length sceneFlash_load returns, a restored scene is not written again
+    memcpy(pending.data, frame->data, length);
+    memset(pending.data + length, 0, SCENE_FLASH_DATA_SIZE - length);
+
+    pending_valid = true;
+    pending_since = timebase_now();
+}
+
+void sceneFlash_loop(void)
+{
+    if (!pending_valid)
+        return;
+    if (timebase_now() - pending_since < SCENE_FLASH_COMMIT_DELAY)
+        return; // the scene is still changing
+
+    if (latest_slot >= 0
+            && memcmp(&pending.cmd, &sceneFlash_record(latest_slot)->cmd,
+                      2 + SCENE_FLASH_DATA_SIZE) == 0)
+    {
+        pending_valid = false;
+        return; // already stored
+    }
+
+    // RDY is lowered before the receiver is checked, the ESP could start a frame right after the check otherwise
+    const bool incoming = mesp_isIncomingEnabled();
+    mesp_disableIncoming(); // the ESP must not send while the CPU is stalled by the flash controller
+    __delay_cycles(MESP_RDY_GUARD_CYCLES); // a frame the ESP has started meanwhile is being received by now
+    if (!mesp_isReceiving()) // else writing stalls the CPU, do not lose incoming bytes and try again later
+    {
+        pending_valid = false;
+        sceneFlash_commit();
+    }
+    if (incoming)
+        mesp_enableIncoming(); // RDY stays low if the lamp does not accept frames
+}
+
+static inline const sceneFlash_record_t* sceneFlash_record(uint16_t slot)
+{
+    return (const sceneFlash_record_t*) (SCENE_FLASH_START
+            + (slot / SCENE_FLASH_SLOTS_PER_SEGMENT) * SCENE_FLASH_SEGMENT_SIZE
+            + (slot % SCENE_FLASH_SLOTS_PER_SEGMENT)
+                    * sizeof(sceneFlash_record_t));
+}
+
+static uint8_t sceneFlash_checksum(const sceneFlash_record_t *record)
+{
+    const uint8_t *bytes = (const uint8_t*) record;
+    uint8_t sum = 0;
+
+    uint8_t i;
+    for (i = 0; i < offsetof(sceneFlash_record_t, checksum); i++)
+        sum += bytes[i];
+    return ~sum;
+}
+
+static bool sceneFlash_isBlank(uint16_t slot)
+{
+    const uint8_t *bytes = (const uint8_t*) sceneFlash_record(slot);
+
+    uint8_t i;
+    for (i = 0; i < sizeof(sceneFlash_record_t); i++)
+        if (bytes[i] != 0xFF)
+            return false;
+    return true;
+}
+
+static void sceneFlash_commit(void)
+{
+    uint16_t slot = latest_slot < 0 ? 0 : (latest_slot + 1) % SCENE_FLASH_SLOT_COUNT;
+
+    // Slots after the newest record can hold an interrupted record, they are skipped.
+    // The first slot of a segment is only reached after the newest record has left that segment.
+    while (!sceneFlash_isBlank(slot))
+    {
+        if (slot % SCENE_FLASH_SLOTS_PER_SEGMENT == 0)
+            sceneFlash_eraseSegment((uint8_t*) sceneFlash_record(slot));
+        else
+            slot = (slot + 1) % SCENE_FLASH_SLOT_COUNT;
+    }
+
+    pending.sequence = sequence + 1;
+    pending.checksum = sceneFlash_checksum(&pending);
+    pending.valid = SCENE_FLASH_VALID;
+
+    uint8_t *destination = (uint8_t*) sceneFlash_record(slot);
+    sceneFlash_write(destination, (const uint8_t*) &pending,
+                     offsetof(sceneFlash_record_t, valid));
+    sceneFlash_write(destination + offsetof(sceneFlash_record_t, valid),
+                     &pending.valid, 1); // the record is valid from now on
+
+    latest_slot = slot;
+    sequence = pending.sequence;
+}
+
+static void sceneFlash_eraseSegment(uint8_t *segment)
+{
+    FCTL3 = FWKEY;         // Clear Lock bit
+    FCTL1 = FWKEY + ERASE; // Set Erase bit
+    *segment = 0;          // Dummy write to erase the flash segment
+    FCTL1 = FWKEY;         // Clear Erase bit
+    FCTL3 = FWKEY + LOCK;  // Set LOCK bit
+}
+
+static void sceneFlash_write(uint8_t *destination, const uint8_t *source,
+                             uint8_t length)
+{
+    FCTL3 = FWKEY;       // Clear Lock bit
+    FCTL1 = FWKEY + WRT; // Set WRT bit for write operation
+    while (length--)
+        *destination++ = *source++;
+    FCTL1 = FWKEY;        // Clear WRT bit
+    FCTL3 = FWKEY + LOCK; // Set LOCK bit
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+#ifndef SCENE_FLASH_H_
+#define SCENE_FLASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mesp.h"
+#include "ws2812b.h"
+#include "timebase.h"
+
+// Information memory segments D, C and B are used as a ring of records. Segment A is left alone.
+#ifndef SCENE_FLASH_START
+#define SCENE_FLASH_START 0x1800
+#endif
+#define SCENE_FLASH_SEGMENT_SIZE 0x80
+#define SCENE_FLASH_SEGMENT_COUNT 3
+
+// A scene has to stay unchanged this long before it is written to the flash
+#define SCENE_FLASH_COMMIT_DELAY TIMEBASE_MS(5000)
+
+// Maximum data length of a stored frame, longer frames are truncated
+#if WS2812B_LED_COUNT * WS2812B_CHANNEL_COUNT > SCENE_FLASH_SEGMENT_SIZE - 6
+#define SCENE_FLASH_DATA_SIZE (SCENE_FLASH_SEGMENT_SIZE - 6)
+#else
+#define SCENE_FLASH_DATA_SIZE (WS2812B_LED_COUNT * WS2812B_CHANNEL_COUNT)
+#endif
+
+/**
+ * This function finds the newest valid scene in the flash.
+ *
+ * @param frame The frame to load the scene into, 'frame->data' has to hold SCENE_FLASH_DATA_SIZE bytes
+ *
+ * @return true if a scene has been loaded, false if the flash holds no valid scene
+ */
+extern bool sceneFlash_load(mesp_data_frame_t *frame);
+
+/**
+ * This function remembers a frame as the current scene.
+ * It is written to the flash by sceneFlash_loop once it has not changed for SCENE_FLASH_COMMIT_DELAY.
+ *
+ * @param frame The frame that has been applied
+ */
+extern void sceneFlash_store(const mesp_data_frame_t *frame);
+
+/**
+ * This function writes the current scene to the flash when it is due.
+ * The flash is not written while a frame is being received. RDY is low while the flash is written and
+ * restored afterwards.
+ */
+extern void sceneFlash_loop(void);
+
+#endif /* SCENE_FLASH_H_ */
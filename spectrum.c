@@ -0,0 +1,248 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+#include "spectrum.h"
+
+/**
+ * The samples are scaled down by a power of two until their magnitude is at most this, see spectrum_prescale.
+ * The goertzel state of the lowest bin (the highest gain) then stays below 830 * 64 = 53150 for any input,
+ * so the Q14 product of the coefficient and the state fits into 32 bits (16x32 multiply on the MPY32).
+ */
+#define SPECTRUM_SAMPLE_PEAK 63
+
+/**
+ * Goertzel coefficients 2 * cos(2 * pi * k / N) in Q14 format for N = 128 and fs = 8kHz.
+ * Bin k has a center frequency of k * 62.5Hz.
+ */
+static const int16_t coefficients[SPECTRUM_BAND_COUNT] = {
+    32610,  // k =  2,  125.0Hz
+    32413,  // k =  3,  187.5Hz
+    31786,  // k =  5,  312.5Hz
+    30274,  // k =  8,  500.0Hz
+    27246,  // k = 12,  750.0Hz
+    19520,  // k = 19, 1187.5Hz
+    3212,   // k = 30, 1875.0Hz
+    -23170  // k = 48, 3000.0Hz
+};
+
+/**
+ * The sample buffers. DMA fills one of them while the other one is being processed.
+ * spectrum_process scales the samples of a complete block in place.
+ */
+static int16_t samples[2][SPECTRUM_BLOCK_SIZE];
+
+static volatile uint8_t active_buffer = 0; // buffer that is currently filled by the DMA
+static volatile uint8_t ready_buffer = 0;  // buffer that holds the newest complete block
+static volatile bool block_ready = false;
+
+// static functions not to be exposed to the user:
+
+/**
+ * This function removes the dc offset from the samples and scales them down to at most SPECTRUM_SAMPLE_PEAK.
+ *
+ * @param block The sample block, modified in place
+ * @param mean The dc offset of the sample block
+ *
+ * @return The number of bits the samples have been shifted right by
+ */
+static uint8_t spectrum_prescale(int16_t *block, int16_t mean);
+
+/**
+ * This function computes the power of a single frequency bin using the goertzel algorithm.
+ *
+ * @param block The scaled sample block (see spectrum_prescale)
+ * @param coefficient The goertzel coefficient of the bin in Q14 format
+ *
+ * @return The power of the bin in units of the scaled samples
+ */
+static int32_t spectrum_goertzel(const int16_t *block, int16_t coefficient);
+
+/**
+ * This function maps the power of a bin onto a logarithmic brightness level.
+ *
+ * @param power The power of the bin in units of the scaled samples
+ * @param shift The number of bits the samples have been shifted right by
+ *
+ * @return The brightness level (0-255)
+ */
+static uint8_t spectrum_level(int32_t power, uint8_t shift);
+
+/**
+ * This function points DMA channel 0 to the active buffer and enables it.
+ */
+static inline void spectrum_armDMA(void);
+
+void spectrum_start(void)
+{
+    P6SEL |= BIT0; // A0 as analog input
+
+    // Timer_A0: CCR1 output generates a rising edge at the sample rate
+    TA0CTL = TASSEL_2 + MC_0 + TACLR; // SMCLK, stopped
+    TA0CCR0 = SPECTRUM_TIMER_PERIOD - 1;
+    TA0CCR1 = SPECTRUM_TIMER_PERIOD / 2;
+    TA0CCTL1 = OUTMOD_3; // set/reset
+
+    // ADC12: repeat single channel A0, triggered by TA0.1
+    ADC12CTL0 &= ~ADC12ENC;
+    ADC12CTL0 = ADC12SHT0_2 + ADC12ON;                 // 16 ADC12CLK cycles sample time
+    ADC12CTL1 = ADC12SHS_1 + ADC12SHP + ADC12CONSEQ_2; // TA0.1 trigger, sample timer, repeat single channel
+    ADC12CTL2 = ADC12RES_2;                            // 12-bit resolution
+    ADC12MCTL0 = ADC12INCH_0;                          // A0, AVCC reference
+
+    // DMA0: one word per ADC12 conversion, interrupt after every block
+    DMACTL0 = DMA0TSEL_24; // trigger: ADC12IFGx
+    DMA0CTL = DMADT_0 + DMADSTINCR_3 + DMASRCINCR_0 + DMAIE; // single transfer, word to word
+    __data16_write_addr((unsigned short) &DMA0SA, (unsigned long) &ADC12MEM0);
+
+    active_buffer = 0;
+    block_ready = false;
+    spectrum_armDMA();
+
+    ADC12CTL0 |= ADC12ENC;
+    TA0CTL |= MC_1; // start timer in up mode
+}
+
+void spectrum_stop(void)
+{
+    TA0CTL &= ~MC_3;       // stop the timer
+    ADC12CTL0 &= ~ADC12ENC;
+    ADC12CTL0 &= ~ADC12ON; // switch the ADC12 off to save power
+    DMA0CTL &= ~(DMAEN + DMAIE);
+    block_ready = false;
+}
+
+bool spectrum_process(uint8_t *levels)
+{
+    if (!block_ready)
+        return false;
+
+    // The DMA will not touch this buffer until block_ready is cleared
+    int16_t *block = samples[ready_buffer];
+
+    uint32_t sum = 0;
+    uint16_t i;
+    for (i = 0; i < SPECTRUM_BLOCK_SIZE; i++)
+        sum += (uint16_t) block[i]; // 12-bit ADC12 results
+    const int16_t mean = (int16_t) (sum / SPECTRUM_BLOCK_SIZE); // dc offset of the microphone bias
+    const uint8_t shift = spectrum_prescale(block, mean);
+
+    uint8_t band;
+    for (band = 0; band < SPECTRUM_BAND_COUNT; band++)
+    {
+        const uint8_t level = spectrum_level(
+                spectrum_goertzel(block, coefficients[band]), shift);
+
+        // rise immediately, fall off slowly
+        if (level >= levels[band])
+            levels[band] = level;
+        else if (levels[band] - level > SPECTRUM_DECAY)
+            levels[band] -= SPECTRUM_DECAY;
+        else
+            levels[band] = level;
+    }
+
+    block_ready = false; // release the buffer
+    return true;
+}
+
+static uint8_t spectrum_prescale(int16_t *block, int16_t mean)
+{
+    uint16_t peak = 0;
+    uint16_t i;
+    for (i = 0; i < SPECTRUM_BLOCK_SIZE; i++)
+    {
+        block[i] -= mean;
+        const uint16_t magnitude = (uint16_t) (block[i] < 0 ? -block[i] : block[i]);
+        if (magnitude > peak)
+            peak = magnitude;
+    }
+
+    uint8_t shift = 0;
+    while ((peak >> shift) > SPECTRUM_SAMPLE_PEAK)
+        shift++; // at most 6 for 12-bit samples
+
+    if (shift)
+        for (i = 0; i < SPECTRUM_BLOCK_SIZE; i++)
+            block[i] >>= shift;
+    return shift;
+}
+
+static int32_t spectrum_goertzel(const int16_t *block, int16_t coefficient)
+{
+    int32_t s0, s1 = 0, s2 = 0;
+
+    uint16_t i;
+    for (i = 0; i < SPECTRUM_BLOCK_SIZE; i++)
+    {
+        s0 = block[i] + (((int32_t) coefficient * s1) >> 14) - s2;
+        s2 = s1;
+        s1 = s0;
+    }
+
+    // power = s1^2 + s2^2 - coefficient * s1 * s2
+    // The power is below (64 * SPECTRUM_BLOCK_SIZE)^2 = 2^26, the terms may wrap around in between.
+    const int32_t power = (int32_t) ((uint32_t) s1 * (uint32_t) s1
+            + (uint32_t) s2 * (uint32_t) s2
+            - (uint32_t) (((int32_t) coefficient * s1) >> 14) * (uint32_t) s2);
+    return power > 0 ? power : 0; // the rounded Q14 product can make a silent bin slightly negative
+}
+
+static uint8_t spectrum_level(int32_t power, uint8_t shift)
+{
+    uint8_t bits = 2 * shift; // the power scales with the square of the samples
+    while (power > 1)
+    {
+        power >>= 1;
+        bits++;
+    }
+
+    if (bits <= SPECTRUM_FLOOR_BITS)
+        return 0;
+
+    const uint16_t level = (uint16_t) (bits - SPECTRUM_FLOOR_BITS)
+            * SPECTRUM_LEVEL_PER_BIT;
+    return level > 255 ? 255 : (uint8_t) level;
+}
+
+static inline void spectrum_armDMA(void)
+{
+    __data16_write_addr((unsigned short) &DMA0DA,
+                        (unsigned long) samples[active_buffer]);
+    DMA0SZ = SPECTRUM_BLOCK_SIZE;
+    DMA0CTL |= DMAEN;
+}
+
+#pragma vector = DMA_VECTOR
+__interrupt void DMA_ISR(void)
+{
+    switch (__even_in_range(DMAIV, 16))
+    {
+    case 0: // Vector 0 - no interrupt
+        break;
+    case 2: // Vector 2 - DMA0IFG, a block is complete
+        if (!block_ready)
+        {
+            ready_buffer = active_buffer; // hand the block over to spectrum_process
+            active_buffer ^= 1;
+            block_ready = true;
+        }
+        // else the previous block has not been processed yet, drop this one and refill the same buffer
+        spectrum_armDMA();
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+#ifndef SPECTRUM_H_
+#define SPECTRUM_H_
+
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// DO NOT TOUCH THESE WITHOUT UPDATING THE GOERTZEL COEFFICIENTS IN spectrum.c!
+#define SPECTRUM_SAMPLE_RATE 8000 // Hz, microphone sampling rate
+#define SPECTRUM_BLOCK_SIZE 128   // samples per block (16ms at 8kHz => 62.5 frames per second)
+#define SPECTRUM_BAND_COUNT 8     // number of frequency bands
+
+// Timer period for the ADC12 trigger. Requires SMCLK to run at 25MHz (see ws2812b_initClockTo25MHz).
+#define SPECTRUM_TIMER_PERIOD (25000000UL / SPECTRUM_SAMPLE_RATE)
+
+// Band levels below 2^SPECTRUM_FLOOR_BITS (goertzel power) are treated as silence
+#define SPECTRUM_FLOOR_BITS 20
+// Brightness steps per bit of goertzel power above the floor (one bit = ~3dB)
+#define SPECTRUM_LEVEL_PER_BIT 16
+// Brightness decay per frame, makes the bands fall off smoothly
+#define SPECTRUM_DECAY 12
+
+/**
+ * This function starts sampling the microphone at P6.0 (A0).
+ * Timer_A0 triggers the ADC12 at SPECTRUM_SAMPLE_RATE and DMA channel 0 moves the results
+ * into one of two sample buffers without any CPU involvement.
+ */
+extern void spectrum_start(void);
+
+/**
+ * This function stops the timer, the ADC12 and the DMA channel.
+ */
+extern void spectrum_stop(void);
+
+/**
+ * This function computes the band levels of the newest complete sample block.
+ * The block is scaled down to a common exponent and processed with a bank of fixed-point goertzel filters,
+ * one per band, without any 64-bit arithmetic.
+ * This has to be called at least once per block period (16ms) or blocks will be dropped.
+ *
+ * @param levels Array of SPECTRUM_BAND_COUNT band levels (0-255), updated in place
+ *
+ * @return true if a new block has been processed, false if no new block was available
+ */
+extern bool spectrum_process(uint8_t *levels);
+
+#endif /* SPECTRUM_H_ */
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+#include "timebase.h"
+
+/**
+ * The upper 16 bits of the tick counter, the lower 16 bits are TA1R.
+ */
+static volatile uint16_t overflows = 0;
+
+void timebase_init(void)
+{
+    overflows = 0;
+    TA1CTL = TASSEL_1 + MC_2 + TACLR + TAIE; // ACLK, continuous mode, overflow interrupt
+}
+
+uint32_t timebase_now(void)
+{
+    const uint16_t sr = __get_SR_register();
+    __disable_interrupt();
+
+    uint16_t low;
+    do // TA1R runs asynchronous to MCLK, read it until two reads match
+    {
+        low = TA1R;
+    }
+    while (low != TA1R);
+
+    uint16_t high = overflows;
+    if ((TA1CTL & TAIFG) && low < 0x8000)
+        high++; // the counter overflowed but the interrupt has not been served yet
+
+    __bis_SR_register(sr & GIE); // restore the interrupt state
+    return ((uint32_t) high << 16) | low;
+}
+
+#pragma vector = TIMER1_A1_VECTOR
+__interrupt void TIMER1_A1_ISR(void)
+{
+    switch (__even_in_range(TA1IV, 14))
+    {
+    case 0: // Vector 0 - no interrupt
+        break;
+    case 14: // Vector 14 - TAIFG, counter overflow
+        overflows++;
+        __bic_SR_register_on_exit(LPM3_bits); // wake up the main loop every 2 seconds to check its timers
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2022 Philip Prohaska and Jonathan Margreiter
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *See the License for the specific language governing permissions and
+ *limitations under the License.
+ */
+
+#ifndef TIMEBASE_H_
+#define TIMEBASE_H_
+
+#include <msp430.h>
+#include <stdint.h>
+
+#define TIMEBASE_FREQUENCY 32768UL // ticks per second, Timer_A1 runs from ACLK (XT1)
+
+// Converts milliseconds to ticks
+#define TIMEBASE_MS(ms) ((uint32_t) ((ms) * TIMEBASE_FREQUENCY / 1000))
+
+/**
+ * This function starts Timer_A1 as a free running 32-bit tick counter.
+ * The counter keeps running in LPM3 as it is clocked by ACLK and leaves LPM3 on every overflow (every 2 seconds).
+ */
+extern void timebase_init(void);
+
+/**
+ * This function returns the current tick count. It wraps around after about 36 hours,
+ * compare ticks by subtracting them.
+ *
+ * @return The ticks since timebase_init
+ */
+extern uint32_t timebase_now(void);
+
+#endif /* TIMEBASE_H_ */
@@ -16,14 +16,52 @@
 
 #include "ws2812b.h"
 
+// FLL multiplier of the selected clock, MCLK = SMCLK = DCOCLK = 32768Hz * WS2812B_FLL_MULTIPLIER (FLLD_0)
+#if defined(WS2812B_CLOCK_25MHz)
+#define WS2812B_FLL_MULTIPLIER 763
+#elif defined(WS2812B_CLOCK_16MHz)
+#define WS2812B_FLL_MULTIPLIER 488
+#elif defined(WS2812B_CLOCK_8MHz)
+#define WS2812B_FLL_MULTIPLIER 244
+#else
+#error "No clock selected, define one of WS2812B_CLOCK_25MHz, WS2812B_CLOCK_16MHz or WS2812B_CLOCK_8MHz"
+#endif
+
+// SMCLK cycles per ACLK period once the FLL has locked, see ws2812b_waitForLock
+#define WS2812B_LOCK_CYCLES WS2812B_FLL_MULTIPLIER
+#define WS2812B_LOCK_TOLERANCE (WS2812B_LOCK_CYCLES / 128) // +-0.8%, one DCO tap is ~8%
+#define WS2812B_LOCK_PERIODS 2     // consecutive ACLK periods within the tolerance
+#define WS2812B_LOCK_TIMEOUT 1024  // ACLK periods (31ms), longer than the worst-case DCO settling time
+
+/**
+ * The led strip models.
+ * The front buffer holds the color data that is displayed by ws2812b_showStrip,
+ * the back buffer can be filled with raw color data and exchanged with ws2812b_swapBuffers.
+ */
+static ws2812b_led_t led_buffers[2][WS2812B_LED_COUNT] = { { { 0 } } };
+
+static ws2812b_led_t *leds = led_buffers[0];      // front buffer
+static ws2812b_led_t *back_leds = led_buffers[1]; // back buffer
+
 /**
- * The led strip model.
- * This array will save all of the color data of the leds strip.
+ * Sum of each color channel over the front buffer, in the order red, green, blue (, white).
+ * The sums are updated whenever a led changes so the current can be estimated without scanning the strip.
  */
-static ws2812b_led_t leds[WS2812B_LED_COUNT] = { { 0, 0, 0 } };
+static uint32_t channel_sums[WS2812B_CHANNEL_COUNT] = { 0 };
+
+static bool clock_lowered = false; // set by ws2812b_lowerClock
+static uint16_t locked_taps = 0x0000; // UCSCTL0 of the locked FLL at full speed, saved by ws2812b_lowerClock
 
 // static functions not to be exposed to the user:
 
+/**
+ * This function transmits one byte using the USCI_B0_SPI module.
+ *
+ * @param byte The byte to transmit via SPI
+ */
+static inline void ws2812b_transmitByte(uint8_t byte);
+
+#ifndef WS2812B_CHIP_APA102
 /**
  * This function encodes the given byte using 6 bit encoding.
  *
@@ -34,11 +72,54 @@ static ws2812b_led_t leds[WS2812B_LED_COUNT] = { { 0, 0, 0 } };
 static uint64_t ws2812b_encode_byte_6bit(uint8_t byte);
 
 /**
- * This function transmits one byte using the USCI_B0_SPI module.
+ * This function transmits a byte encoded using 6 bit encoding, the upper 2 bytes are not sent.
  *
- * @param byte The byte to transmit via SPI
+ * @param encoded The encoded byte
  */
-static inline void ws2812b_transmitByte(uint8_t byte);
+static inline void ws2812b_transmitEncoded(uint64_t *encoded);
+#endif
+
+/**
+ * This function computes the channel sums of the whole front buffer.
+ */
+static void ws2812b_sumChannels(void);
+
+/**
+ * This function computes the factor all colors have to be scaled with to stay within the current budget.
+ *
+ * @return The factor, 256 means the colors are not scaled
+ */
+static uint16_t ws2812b_powerScale(void);
+
+/**
+ * This function scales a color value.
+ *
+ * @param value The color value
+ * @param scale The factor, 256 returns the value unchanged
+ *
+ * @return The scaled color value
+ */
+static inline uint8_t ws2812b_scale(uint8_t value, uint16_t scale);
+
+/**
+ * This function starts switching the MSP MCLK and SMCLK to 25MHz.
+ *
+ * @param taps The DCOx and MODx bits (UCSCTL0) the FLL starts from
+ */
+static void ws2812b_startClock(uint16_t taps);
+
+/**
+ * This function waits until the FLL has locked by counting SMCLK cycles between rising edges of ACLK
+ * with Timer_B0. It gives up after WS2812B_LOCK_TIMEOUT periods of ACLK.
+ */
+static void ws2812b_waitForLock(void);
+
+/**
+ * This function waits for the next rising edge of ACLK captured by Timer_B0.
+ *
+ * @return The Timer_B0 count at the edge
+ */
+static inline uint16_t ws2812b_captureACLK(void);
 
 /**
  * This function increases the vcore to the specified level.
@@ -48,11 +129,20 @@ static inline void ws2812b_transmitByte(uint8_t byte);
  */
 static void ws2812b_set_vcore(unsigned int level);
 
+/**
+ * This function decreases the vcore to the specified level.
+ * Note that the vcore has to be decreased one step at a time and only after the clock has been lowered.
+ *
+ * @param level The level the vcore should be set to
+ */
+static void ws2812b_lower_vcore(unsigned int level);
+
 void ws2812b_init()
 {
-    ws2812b_initClockTo25MHz(); // set clock to 25MHz. This is necessary to get the timing right for the leds.
-    ws2812b_initSPI();          // Initialize the USCI_B0_SPI module
+    ws2812b_startClockTo25MHz(); // set clock to 25MHz. This is necessary to get the timing right for the leds.
+    ws2812b_initSPI();           // Initialize the USCI_B0_SPI module while the clock settles
     ws2812b_clearStrip();
+    ws2812b_waitForClock();
     ws2812b_showStrip();
 }
 
@@ -60,11 +150,19 @@ void ws2812b_initSPI()
 {
     UCB0CTL1 |= UCSWRST; // Put USCI state machin in reset
 
+#ifdef WS2812B_CHIP_APA102
+    P3SEL |= BIT0 + BIT2;                  // configure data and clock pin as SPI output
+#else
     P3SEL |= BIT0;                         // configure output pin as SPI output
                                            //    P3SEL2 |= OUTPUT_PIN;
+#endif
     UCB0CTL0 |= UCCKPH + UCMSB + UCMST + UCSYNC; // 3-pin, MSB, 8-bit SPI master
     UCB0CTL1 |= UCSSEL_2;                        // SMCLK source (16 MHz)
+#ifdef WS2812B_CHIP_APA102
+    UCB0BR0 = WS2812B_APA102_CLOCK_DIVIDER; // clocked chip, no timing requirements
+#else
     UCB0BR0 = 5;                // 25 MHz / 5 = .2 us per bit (.1875 us per bit)
+#endif
     UCB0BR1 = 0;
     UCB0CTL1 &= ~UCSWRST; // Initialize USCI state machine
 }
@@ -73,65 +171,145 @@ void ws2812b_setLEDColor(uint16_t p, uint8_t r, uint8_t g, uint8_t b)
 {
     if (p < WS2812B_LED_COUNT) // protection against memory overflow
     {
+        channel_sums[0] += r - leds[p].red; // unsigned arithmetic wraps around correctly
+        channel_sums[1] += g - leds[p].green;
+        channel_sums[2] += b - leds[p].blue;
+#if WS2812B_CHANNEL_COUNT == 4
+        channel_sums[3] -= leds[p].white;
+#endif
         leds[p].green = g;
         leds[p].red = r;
         leds[p].blue = b;
+#if WS2812B_CHANNEL_COUNT == 4
+        leds[p].white = 0;
+#endif
     }
 }
 
-void ws2812b_showStrip(void)
+#if WS2812B_CHANNEL_COUNT == 4
+void ws2812b_setLEDWhite(uint16_t p, uint8_t w)
 {
-    uint64_t colors[3][WS2812B_LED_COUNT] = { { 0 } }; // Array for all the encoded led data
+    if (p < WS2812B_LED_COUNT) // protection against memory overflow
+    {
+        channel_sums[3] += w - leds[p].white;
+        leds[p].white = w;
+    }
+}
+#endif
 
-    uint64_t *green = colors[0];
-    uint64_t *red = colors[1];
-    uint64_t *blue = colors[2];
+uint8_t* ws2812b_getBackBuffer(void)
+{
+    return (uint8_t*) back_leds;
+}
 
-    uint8_t *g, *r, *b; // 8-bit color chunks to send with SPI 
+void ws2812b_swapBuffers(uint16_t length)
+{
+    ws2812b_led_t *front = back_leds;
+    back_leds = leds;
+    leds = front;
 
+    for (; length < WS2812B_LED_COUNT; length++) // keep the leds that have not been written
+        leds[length] = back_leds[length];
+
+    ws2812b_sumChannels(); // the whole strip has been replaced, the receiver has not kept any sums
+}
+
+uint32_t ws2812b_estimateCurrent(void)
+{
+    uint32_t sum = 0;
+    uint8_t c;
+    for (c = 0; c < WS2812B_CHANNEL_COUNT; c++)
+        sum += channel_sums[c];
+
+    return (uint32_t) WS2812B_POWER_IDLE_MA * WS2812B_LED_COUNT
+            + sum * WS2812B_POWER_CHANNEL_MA / 255;
+}
+
+void ws2812b_showStrip(void)
+{
     uint16_t i; // looping variable
-    for (i = 0; i < WS2812B_LED_COUNT; i++)
+    const uint16_t scale = ws2812b_powerScale();
+
+    ws2812b_restoreClock(); // the timing is only right at full speed
+
+#ifdef WS2812B_CHIP_APA102
+    // start frame
+    ws2812b_transmitByte(0x00);
+    ws2812b_transmitByte(0x00);
+    ws2812b_transmitByte(0x00);
+    ws2812b_transmitByte(0x00);
+
+    if (scale == 256) // within the budget, the colors are sent as they are
+    {
+        for (i = 0; i < WS2812B_LED_COUNT; i++)
+        {
+            ws2812b_transmitByte(0xE0 | WS2812B_APA102_BRIGHTNESS);
+            ws2812b_transmitByte(leds[i].WS2812B_CHANNEL_0);
+            ws2812b_transmitByte(leds[i].WS2812B_CHANNEL_1);
+            ws2812b_transmitByte(leds[i].WS2812B_CHANNEL_2);
+        }
+    }
+    else
+    {
+        for (i = 0; i < WS2812B_LED_COUNT; i++)
+        {
+            ws2812b_transmitByte(0xE0 | WS2812B_APA102_BRIGHTNESS);
+            ws2812b_transmitByte(ws2812b_scale(leds[i].WS2812B_CHANNEL_0, scale));
+            ws2812b_transmitByte(ws2812b_scale(leds[i].WS2812B_CHANNEL_1, scale));
+            ws2812b_transmitByte(ws2812b_scale(leds[i].WS2812B_CHANNEL_2, scale));
+        }
+    }
+
+    // end frame: SK9822 latches with 32 zero bits, APA102 needs another clock edge for every 2 leds
+    ws2812b_transmitByte(0x00);
+    ws2812b_transmitByte(0x00);
+    ws2812b_transmitByte(0x00);
+    ws2812b_transmitByte(0x00);
+    for (i = 0; i < (WS2812B_LED_COUNT + 15) / 16; i++)
+        ws2812b_transmitByte(0x00);
+#else
+    uint64_t colors[WS2812B_CHANNEL_COUNT][WS2812B_LED_COUNT] = { { 0 } }; // Array for all the encoded led data
+
+    // The colors are encoded in advance, there is no time for it between the bytes
+    if (scale == 256) // within the budget, the colors are encoded as they are
+    {
+        for (i = 0; i < WS2812B_LED_COUNT; i++)
+        {
+            colors[0][i] = ws2812b_encode_byte_6bit(leds[i].WS2812B_CHANNEL_0);
+            colors[1][i] = ws2812b_encode_byte_6bit(leds[i].WS2812B_CHANNEL_1);
+            colors[2][i] = ws2812b_encode_byte_6bit(leds[i].WS2812B_CHANNEL_2);
+#if WS2812B_CHANNEL_COUNT == 4
+            colors[3][i] = ws2812b_encode_byte_6bit(leds[i].white);
+#endif
+        }
+    }
+    else
     {
-        colors[0][i] = ws2812b_encode_byte_6bit(leds[i].green);
-        colors[1][i] = ws2812b_encode_byte_6bit(leds[i].red);
-        colors[2][i] = ws2812b_encode_byte_6bit(leds[i].blue);
+        for (i = 0; i < WS2812B_LED_COUNT; i++)
+        {
+            colors[0][i] = ws2812b_encode_byte_6bit(
+                    ws2812b_scale(leds[i].WS2812B_CHANNEL_0, scale));
+            colors[1][i] = ws2812b_encode_byte_6bit(
+                    ws2812b_scale(leds[i].WS2812B_CHANNEL_1, scale));
+            colors[2][i] = ws2812b_encode_byte_6bit(
+                    ws2812b_scale(leds[i].WS2812B_CHANNEL_2, scale));
+#if WS2812B_CHANNEL_COUNT == 4
+            colors[3][i] = ws2812b_encode_byte_6bit(
+                    ws2812b_scale(leds[i].white, scale));
+#endif
+        }
     }
 
     for (i = 0; i < WS2812B_LED_COUNT; i++)
     {
-        g = (uint8_t*) &green[i]; // get the 8 bit chunks for green
-        r = (uint8_t*) &red[i];   // get the 8 bit chunks for red
-        b = (uint8_t*) &blue[i];  // get the 8 bit chunks for blue
-        /*
-         * Color encoding (saved in 64-bit variable, upper 2 bytes not used):
-         * Encoded color: 11aa0011 bb0011cc 0011dd00 11ee0011 ff0011gg 0011hh00
-         * Byte index:              5              4              3               2            1              0
-         *
-         */
-        // green
-        ws2812b_transmitByte(*(g + 5));
-        ws2812b_transmitByte(*(g + 4));
-        ws2812b_transmitByte(*(g + 3));
-        ws2812b_transmitByte(*(g + 2));
-        ws2812b_transmitByte(*(g + 1));
-        ws2812b_transmitByte(*(g + 0));
-
-        // red
-        ws2812b_transmitByte(*(r + 5));
-        ws2812b_transmitByte(*(r + 4));
-        ws2812b_transmitByte(*(r + 3));
-        ws2812b_transmitByte(*(r + 2));
-        ws2812b_transmitByte(*(r + 1));
-        ws2812b_transmitByte(*(r + 0));
-
-        // blue
-        ws2812b_transmitByte(*(b + 5));
-        ws2812b_transmitByte(*(b + 4));
-        ws2812b_transmitByte(*(b + 3));
-        ws2812b_transmitByte(*(b + 2));
-        ws2812b_transmitByte(*(b + 1));
-        ws2812b_transmitByte(*(b + 0));
+        ws2812b_transmitEncoded(&colors[0][i]);
+        ws2812b_transmitEncoded(&colors[1][i]);
+        ws2812b_transmitEncoded(&colors[2][i]);
+#if WS2812B_CHANNEL_COUNT == 4
+        ws2812b_transmitEncoded(&colors[3][i]);
+#endif
     }
+#endif
 }
 
 void ws2812b_clearStrip(void)
@@ -152,6 +330,17 @@ void ws2812b_fillStripColor(ws2812b_led_t *color)
 }
 
 void ws2812b_initClockTo25MHz(void)
+{
+    ws2812b_startClockTo25MHz();
+    ws2812b_waitForClock();
+}
+
+void ws2812b_startClockTo25MHz(void)
+{
+    ws2812b_startClock(0x0000); // lowest DCOx, MODx, the FLL has to search its way up
+}
+
+static void ws2812b_startClock(uint16_t taps)
 {
     // clock config for MSP430F5529
 
@@ -159,13 +348,8 @@ void ws2812b_initClockTo25MHz(void)
     UCSCTL6 &= ~(XT1OFF + XCAP_3); // XT1 On, clear internal load caps
     UCSCTL6 |= XCAP_0; // internal load caps 2pF, 6pF, 9pF or 12pF could be selected, XCAP_0 => 2pF
 
-    do // loop until XT1 fault flag is cleared
-    {
-        UCSCTL7 &= ~XT1LFOFFG;     // clear XT1 fault flags
-    }
-    while (UCSCTL7 & XT1LFOFFG); // test XT1 fault flag
-
-    UCSCTL6 &= ~(XT1DRIVE_3); // reduce XT1driver strength to the lowest level
+    // XT1 is not waited for here. Until it is stable the FLL falls back to REFO as reference,
+    // XT1 starts up while the vcore is raised. See ws2812b_waitForClock.
 
     __bis_SR_register(SCG0); // disable the FLL control loop
 
@@ -174,9 +358,9 @@ void ws2812b_initClockTo25MHz(void)
     ws2812b_set_vcore(0x02); // ...to support fsystem=25MHz
     ws2812b_set_vcore(0x03); // NOTE: Change core voltage one level at a time
 
-    UCSCTL0 = 0x0000;       // Set lowest possible DCOx, MODx
+    UCSCTL0 = taps;         // Set DCOx, MODx the FLL starts from
     UCSCTL1 = DCORSEL_7;    // select DCO range 50MHz
-    UCSCTL2 = FLLD_0 + 762; // 32768Hz * (762 + 1) = 25MHz
+    UCSCTL2 = FLLD_0 + WS2812B_FLL_MULTIPLIER - 1; // 32768Hz * (762 + 1) = 25MHz
 #endif
 
 #ifdef WS2812B_CLOCK_16MHz
@@ -184,14 +368,14 @@ void ws2812b_initClockTo25MHz(void)
     ws2812b_set_vcore(0x02); // ...to support fsystem=16MHz
     ws2812b_set_vcore(0x03); // NOTE: Change core voltage one level at a time
 
-    UCSCTL0 = 0x0000;       // Set lowest possible DCOx, MODx
+    UCSCTL0 = taps;         // Set DCOx, MODx the FLL starts from
     UCSCTL1 = DCORSEL_5;    // select DCO range 16MHz
-    UCSCTL2 = FLLD_0 + 487; // 32768Hz * (487 + 1) = 16MHz
+    UCSCTL2 = FLLD_0 + WS2812B_FLL_MULTIPLIER - 1; // 32768Hz * (487 + 1) = 16MHz
 #endif
 
 #ifdef WS2812B_CLOCK_8MHz
     UCSCTL1 = DCORSEL_3;    // select DCO range 1MHz to 10MHz
-    UCSCTL2 = FLLD_1 + 243; // 32768Hz * (243 + 1) = 8MHz
+    UCSCTL2 = FLLD_0 + WS2812B_FLL_MULTIPLIER - 1; // 32768Hz * (243 + 1) = 8MHz, SMCLK is DCOCLK
 #endif
 
     UCSCTL3 = SELREF_0 + FLLREFDIV_0; // Set DCO FLL reference = XT1, FLL reference divider 1
@@ -199,24 +383,95 @@ void ws2812b_initClockTo25MHz(void)
     UCSCTL5 = DIVPA_0 + DIVA_0 + DIVS_0 + DIVM_0; // select clock dividers
 
     __bic_SR_register(SCG0); // enable the FLL control loop
+}
 
-    // Worst-case settling time for the DCO when the DCO range bits have been
-    // changed is n x 32 x 32 x f_MCLK / f_FLL_reference. See UCS chapter in 5xx
-    // UG for optimization.
+void ws2812b_waitForClock(void)
+{
+    // The fault flags can not tell whether the FLL has locked, DCOFFG is cleared as soon as the DCO
+    // has left its lowest tap, long before it reaches 25MHz. The frequency is measured instead.
+    ws2812b_waitForLock();
+    ws2812b_checkXT1();
+}
 
-#ifdef WS2812B_CLOCK_8MHz
-    __delay_cycles(250000); // 32 x 32 x 8 MHz / 32768 Hz = 250000 = MCLK cycles for DCO to settle
+void ws2812b_lowerClock(void)
+{
+    ws2812b_checkXT1(); // XT1 may have become stable since the clock has been started
+
+    if (clock_lowered)
+        return;
+
+#ifndef WS2812B_CLOCK_8MHz
+    // the last bytes of the strip still shift out at the bit time of the full clock
+    while (UCB0STAT & UCBUSY)
+        ;
+
+    __bis_SR_register(SCG0); // disable the FLL control loop
+    locked_taps = UCSCTL0;   // restored by ws2812b_restoreClock, the FLL does not have to search again
+    UCSCTL0 = 0x0000;        // Set lowest possible DCOx, MODx, the DCO never runs faster than 8MHz from here on
+    UCSCTL1 = DCORSEL_5;     // select DCO range 16MHz
+    UCSCTL2 = FLLD_0 + 243;  // 32768Hz * (243 + 1) = 8MHz
+    __bic_SR_register(SCG0); // enable the FLL control loop
+
+    ws2812b_lower_vcore(0x02); // Decrease Vcore setting to level 0...
+    ws2812b_lower_vcore(0x01); // ...which supports fsystem=8MHz
+    ws2812b_lower_vcore(0x00); // NOTE: Change core voltage one level at a time
 #endif
 
-#ifdef WS2812B_CLOCK_16MHz
-    __delay_cycles(500000); // 32 x 32 x 16 MHz / 32,768 Hz = 500000 = MCLK cycles for DCO to settle
+    clock_lowered = true;
+}
+
+void ws2812b_restoreClock(void)
+{
+    if (!clock_lowered)
+        return;
+
+    ws2812b_startClock(locked_taps); // the FLL only has to correct the drift since it has been locked
+    ws2812b_waitForClock();
+    clock_lowered = false;
+}
+
+static void ws2812b_sumChannels(void)
+{
+    uint8_t c;
+    for (c = 0; c < WS2812B_CHANNEL_COUNT; c++)
+        channel_sums[c] = 0;
+
+    uint16_t i;
+    for (i = 0; i < WS2812B_LED_COUNT; i++)
+    {
+        channel_sums[0] += leds[i].red;
+        channel_sums[1] += leds[i].green;
+        channel_sums[2] += leds[i].blue;
+#if WS2812B_CHANNEL_COUNT == 4
+        channel_sums[3] += leds[i].white;
 #endif
+    }
+}
 
-#ifdef WS2812B_CLOCK_25MHz
-    __delay_cycles(782000); // 32 x 32 x 25 MHz / 32768 Hz = 782000 = MCLK cycles for DCO to settle
+static uint16_t ws2812b_powerScale(void)
+{
+#if WS2812B_POWER_BUDGET_MA > 0
+    const uint32_t current = ws2812b_estimateCurrent();
+    if (current <= WS2812B_POWER_BUDGET_MA)
+        return 256;
+
+    // Only the current of the colors can be scaled, the idle current stays
+    const uint32_t idle = (uint32_t) WS2812B_POWER_IDLE_MA * WS2812B_LED_COUNT;
+    if (idle >= WS2812B_POWER_BUDGET_MA)
+        return 0;
+    return (uint16_t) (((uint32_t) (WS2812B_POWER_BUDGET_MA - idle) << 8)
+            / (current - idle));
+#else
+    return 256;
 #endif
 }
 
+static inline uint8_t ws2812b_scale(uint8_t value, uint16_t scale)
+{
+    return (uint8_t) (((uint16_t) value * scale) >> 8);
+}
+
+#ifndef WS2812B_CHIP_APA102
 static uint64_t ws2812b_encode_byte_6bit(uint8_t byte)
 {
     uint64_t encodedData = WS2812B_MASK_6BIT; // 48bits required!
@@ -243,6 +498,24 @@ static uint64_t ws2812b_encode_byte_6bit(uint8_t byte)
     return encodedData;
 }
 
+static inline void ws2812b_transmitEncoded(uint64_t *encoded)
+{
+    uint8_t *chunks = (uint8_t*) encoded; // 8-bit chunks to send with SPI
+    /*
+     * Color encoding (saved in 64-bit variable, upper 2 bytes not used):
+     * Encoded color: 11aa0011 bb0011cc 0011dd00 11ee0011 ff0011gg 0011hh00
+     * Byte index:              5              4              3               2            1              0
+     *
+     */
+    ws2812b_transmitByte(*(chunks + 5));
+    ws2812b_transmitByte(*(chunks + 4));
+    ws2812b_transmitByte(*(chunks + 3));
+    ws2812b_transmitByte(*(chunks + 2));
+    ws2812b_transmitByte(*(chunks + 1));
+    ws2812b_transmitByte(*(chunks + 0));
+}
+#endif
+
 static inline void ws2812b_transmitByte(uint8_t byte)
 {
     // USCI_B0 TX buffer ready?
@@ -252,12 +525,57 @@ static inline void ws2812b_transmitByte(uint8_t byte)
     UCB0TXBUF = byte;
 }
 
+static void ws2812b_waitForLock(void)
+{
+    TB0CTL = TBSSEL_2 + MC_2 + TBCLR;     // SMCLK, continuous mode
+    TB0CCTL6 = CM_1 + CCIS_1 + SCS + CAP; // capture rising edges of ACLK (CCI6B)
+
+    uint16_t last = ws2812b_captureACLK();
+    uint8_t locked = 0;
+    uint16_t periods;
+    for (periods = 0; periods < WS2812B_LOCK_TIMEOUT && locked < WS2812B_LOCK_PERIODS; periods++)
+    {
+        const uint16_t capture = ws2812b_captureACLK();
+        const uint16_t cycles = capture - last; // the counter wraps around correctly
+        last = capture;
+
+        if (cycles >= WS2812B_LOCK_CYCLES - WS2812B_LOCK_TOLERANCE
+                && cycles <= WS2812B_LOCK_CYCLES + WS2812B_LOCK_TOLERANCE)
+            locked++;
+        else
+            locked = 0;
+    }
+
+    TB0CCTL6 = 0;
+    TB0CTL = MC_0; // stop Timer_B0
+}
+
+static inline uint16_t ws2812b_captureACLK(void)
+{
+    TB0CCTL6 &= ~CCIFG;
+    while (!(TB0CCTL6 & CCIFG))
+        ;
+    return TB0CCR6;
+}
+
+void ws2812b_checkXT1(void)
+{
+    if (!(SFRIFG1 & OFIFG))
+        return; // no fault since the last check, XT1 is already in use
+
+    UCSCTL7 &= ~(XT2OFFG + XT1LFOFFG + DCOFFG); // clear XT2, XT1 and DCO fault flags
+    SFRIFG1 &= ~OFIFG;                          // clear oscillator fault flag
+
+    if (!(UCSCTL7 & XT1LFOFFG)) // the flag is set again while XT1 is not stable
+        UCSCTL6 &= ~(XT1DRIVE_3); // reduce XT1 driver strength to the lowest level
+}
+
 static void ws2812b_set_vcore(unsigned int level)
 {
     PMMCTL0_H = PMMPW_H; // Open PMM registers for write
 
     SVSMHCTL = SVSHE + SVSHRVL0 * level + SVMHE + SVSMHRRL0 * level; // Set SVS/SVM high side new level
-    SVSMLCTL = SVSLE + SVMLE + SVSMLRRL0 * level; // Set SVM low side to new level
+    SVSMLCTL = SVSLE + SVSLFP + SVMLE + SVSMLRRL0 * level; // Set SVM low side to new level, see ws2812b_lower_vcore
 
     while ((PMMIFG & SVSMLDLYIFG) == 0)
         ; // Wait till SVM is settled
@@ -269,7 +587,26 @@ static void ws2812b_set_vcore(unsigned int level)
         while ((PMMIFG & SVMLVLRIFG) == 0)
             ;
 
-    SVSMLCTL = SVSLE + SVSLRVL0 * level + SVMLE + SVSMLRRL0 * level; // Set SVS/SVM low side to new level
+    SVSMLCTL = SVSLE + SVSLFP + SVSLRVL0 * level + SVMLE + SVSMLRRL0 * level; // Set SVS/SVM low side to new level
+
+    PMMCTL0_H = 0x00; // Lock PMM registers for write access
+}
+
+static void ws2812b_lower_vcore(unsigned int level)
+{
+    PMMCTL0_H = PMMPW_H; // Open PMM registers for write
+
+    // Set SVS/SVM low side to new level. The SVS runs in full performance mode, which lets the CPU wake up
+    // from LPM3 in ~5us instead of ~150us, fast enough to read the start code before the next byte arrives.
+    SVSMLCTL = SVSLE + SVSLFP + SVSLRVL0 * level + SVMLE + SVSMLRRL0 * level;
+
+    while ((PMMIFG & SVSMLDLYIFG) == 0)
+        ; // Wait till SVM is settled
+
+    PMMIFG &= ~(SVMLVLRIFG + SVMLIFG); // Clear already set flags
+    PMMCTL0_L = PMMCOREV0 * level;     // Set VCore to new level
+
+    SVSMHCTL = SVSHE + SVSHRVL0 * level + SVMHE + SVSMHRRL0 * level; // Set SVS/SVM high side to new level
 
     PMMCTL0_H = 0x00; // Lock PMM registers for write access
 }
@@ -19,15 +19,84 @@
 
 #include <msp430.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 // Change this to the number of LEDs your strip has (Changes LED strip array size)
+#ifndef WS2812B_LED_COUNT
 #define WS2812B_LED_COUNT 10
+#endif
+
+// Select the led chip of your strip (only one!), here or with -D on the command line of the compiler
+#if !defined(WS2812B_CHIP_WS2812B) && !defined(WS2812B_CHIP_SK6812_RGBW) \
+        && !defined(WS2812B_CHIP_APA102) && !defined(WS2812B_CHIP_SK9822)
+#define WS2812B_CHIP_WS2812B
+//#define WS2812B_CHIP_SK6812_RGBW
+//#define WS2812B_CHIP_APA102 // data at P3.0 and clock at P3.2
+//#define WS2812B_CHIP_SK9822 // data at P3.0 and clock at P3.2
+#endif
+
+// Select the order of the colors only if your strip differs from its chip (only one!)
+// WS2812B and SK6812 use GRB, APA102 and SK9822 use BGR. The white channel of the SK6812 is always sent last.
+//#define WS2812B_ORDER_GRB
+//#define WS2812B_ORDER_RGB
+//#define WS2812B_ORDER_BGR
+
+// APA102/SK9822 only: global brightness (0-31) and SPI clock divider (25MHz / 4 = 6.25MHz)
+#define WS2812B_APA102_BRIGHTNESS 31
+#define WS2812B_APA102_CLOCK_DIVIDER 4
+
+// Current budget of the led power supply in mA, brighter frames are scaled down when they are sent. 0 disables the limiter
+#ifndef WS2812B_POWER_BUDGET_MA
+#define WS2812B_POWER_BUDGET_MA 2000
+#endif
+// Current of a single color channel at full brightness and of a led that is black, in mA
+#define WS2812B_POWER_CHANNEL_MA 20
+#define WS2812B_POWER_IDLE_MA 1
 
 // DO NOT TOUCH THESE OR THE CODE WILL BREAK!
 #define WS2812B_MASK_6BIT 0x0000C30C30C30C30
 
 #define WS2812B_CLOCK_25MHz
 
+#if defined(WS2812B_CHIP_WS2812B) + defined(WS2812B_CHIP_SK6812_RGBW) + defined(WS2812B_CHIP_APA102) \
+        + defined(WS2812B_CHIP_SK9822) != 1
+#error "Select exactly one led chip: WS2812B_CHIP_WS2812B, WS2812B_CHIP_SK6812_RGBW, WS2812B_CHIP_APA102 or WS2812B_CHIP_SK9822"
+#endif
+
+#ifdef WS2812B_CHIP_SK9822
+#define WS2812B_CHIP_APA102 // same frames, the end frame latches both
+#endif
+
+#ifdef WS2812B_CHIP_SK6812_RGBW
+#define WS2812B_CHANNEL_COUNT 4
+#else
+#define WS2812B_CHANNEL_COUNT 3
+#endif
+
+#if defined(WS2812B_ORDER_GRB) + defined(WS2812B_ORDER_RGB) + defined(WS2812B_ORDER_BGR) > 1
+#error "Select at most one color order: WS2812B_ORDER_GRB, WS2812B_ORDER_RGB or WS2812B_ORDER_BGR"
+#elif !defined(WS2812B_ORDER_GRB) && !defined(WS2812B_ORDER_RGB) && !defined(WS2812B_ORDER_BGR)
+#ifdef WS2812B_CHIP_APA102
+#define WS2812B_ORDER_BGR
+#else
+#define WS2812B_ORDER_GRB
+#endif
+#endif
+
+#if defined(WS2812B_ORDER_GRB)
+#define WS2812B_CHANNEL_0 green
+#define WS2812B_CHANNEL_1 red
+#define WS2812B_CHANNEL_2 blue
+#elif defined(WS2812B_ORDER_RGB)
+#define WS2812B_CHANNEL_0 red
+#define WS2812B_CHANNEL_1 green
+#define WS2812B_CHANNEL_2 blue
+#elif defined(WS2812B_ORDER_BGR)
+#define WS2812B_CHANNEL_0 blue
+#define WS2812B_CHANNEL_1 green
+#define WS2812B_CHANNEL_2 red
+#endif
+
 /*
  * This is the data holding container for a single led.
  * A LED-strip is modeled by using an array of this container
@@ -37,6 +106,9 @@ typedef struct
     uint8_t red;
     uint8_t green;
     uint8_t blue;
+#if WS2812B_CHANNEL_COUNT == 4
+    uint8_t white;
+#endif
 } ws2812b_led_t;
 
 /**
@@ -50,7 +122,7 @@ extern void ws2812b_init(void);
 extern void ws2812b_initSPI(void);
 
 /**
- * This function sets the color of a single led at index 'p'.
+ * This function sets the color of a single led at index 'p'. The white channel is turned off.
  *
  * @param p The index of the led
  * @param r The red value of the color
@@ -59,12 +131,52 @@ extern void ws2812b_initSPI(void);
  */
 extern void ws2812b_setLEDColor(uint16_t p, uint8_t r, uint8_t g, uint8_t b);
 
+#if WS2812B_CHANNEL_COUNT == 4
+/**
+ * This function sets the white channel of a single led at index 'p'.
+ *
+ * @param p The index of the led
+ * @param w The white value of the color
+ */
+extern void ws2812b_setLEDWhite(uint16_t p, uint8_t w);
+#endif
+
+/**
+ * This function returns the back buffer of the led strip model.
+ * The back buffer holds WS2812B_LED_COUNT leds of WS2812B_CHANNEL_COUNT bytes each in the order red, green, blue (, white)
+ * and can be written directly, e.g. by a receiver, without calling ws2812b_setLEDColor.
+ *
+ * @return The back buffer
+ */
+extern uint8_t* ws2812b_getBackBuffer(void);
+
+/**
+ * This function exchanges the back buffer with the current led strip.
+ * The leds from index 'length' up to the end of the strip keep their current colors, like ws2812b_setLEDColor
+ * leaves the leds alone that it is not called for.
+ * The back buffer is written without ws2812b_setLEDColor, so the channel sums of the current estimate are
+ * computed here from the whole strip. This is the only place where the limiter's cost grows with the strip.
+ *
+ * @param length The number of leds that have been written to the back buffer
+ */
+extern void ws2812b_swapBuffers(uint16_t length);
+
 /**
  * This function displays the current led strip.
+ * If the estimated current exceeds WS2812B_POWER_BUDGET_MA, all colors are scaled down while they are sent,
+ * the led strip model is not changed. A clock lowered by ws2812b_lowerClock is restored first.
  * Beware that during execution of this function interrupts will be disabled.
  */
 extern void ws2812b_showStrip(void);
 
+/**
+ * This function estimates the current the led strip draws with its current colors.
+ * The estimate uses running sums of the color channels, its cost does not depend on the length of the strip.
+ *
+ * @return The estimated current in mA
+ */
+extern uint32_t ws2812b_estimateCurrent(void);
+
 /**
  * This function fills the led strip with black color values
  */
@@ -87,7 +199,38 @@ extern void ws2812b_fillStrip(uint8_t r, uint8_t g, uint8_t b);
 extern void ws2812b_fillStripColor(ws2812b_led_t *color);
 
 /**
- * This function initializes the MSP MCLK and SMCLK to 25MHz.
+ * This function initializes the MSP MCLK and SMCLK to 25MHz and waits until the clock has settled.
  */
 extern void ws2812b_initClockTo25MHz(void);
+
+/**
+ * This function starts switching the MSP MCLK and SMCLK to 25MHz without waiting for the clock to settle.
+ * Peripherals can be set up in the meantime, but nothing timing critical may run before ws2812b_waitForClock.
+ */
+extern void ws2812b_startClockTo25MHz(void);
+
+/**
+ * This function waits until the FLL has locked MCLK and SMCLK to their target frequency, measured against ACLK
+ * with Timer_B0. XT1 is not waited for, the FLL and ACLK use REFO until XT1 is stable.
+ */
+extern void ws2812b_waitForClock(void);
+
+/**
+ * This function lowers MCLK and SMCLK to 8MHz and the vcore to level 0 to save power while the strip is static.
+ * The clock is restored by ws2812b_restoreClock or at the latest by the next ws2812b_showStrip.
+ */
+extern void ws2812b_lowerClock(void);
+
+/**
+ * This function restores the clock that has been lowered by ws2812b_lowerClock and waits until it has settled.
+ * Nothing is done if the clock has not been lowered.
+ */
+extern void ws2812b_restoreClock(void);
+
+/**
+ * This function switches ACLK, the FLL reference and everything clocked by ACLK from REFO to XT1 once XT1 is
+ * stable. The fail-safe logic keeps using REFO until the latched fault flags have been cleared, so it has to be
+ * called periodically, e.g. from the main loop. It returns right away if no oscillator fault is pending.
+ */
+extern void ws2812b_checkXT1(void);
 #endif /* WS2812B_H_ */